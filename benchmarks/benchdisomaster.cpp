@@ -0,0 +1,451 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "benchdisomaster.h"
+#include "../libdisomaster/messagelog.h"
+#include "../libdisomaster/spanplanner.h"
+#include "../libdisomaster/stagingtree.h"
+#include "../libdisomaster/xorrisomessage.h"
+#include "../tests/legacyclassify.h"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <random>
+
+using namespace DISOMasterNS;
+
+/*
+ * DISOMASTERBENCH_DIR: where the pseudo-drives live, /dev/shm (tmpfs)
+ *                      if it is writable, the system temp dir otherwise.
+ * DISOMASTERBENCH_SIZE: size of the test image in MiB, 256 by default.
+ * DISOMASTERBENCH_FILES: number of files spread over discs, 100000 by default;
+ *                        1000000 for the scale of a full archive.
+ */
+BenchDISOMaster::BenchDISOMaster(QObject *parent)
+    : QObject(parent),
+      imagesize(256 << 20)
+{
+}
+
+void BenchDISOMaster::initTestCase()
+{
+    QString base = qgetenv("DISOMASTERBENCH_DIR");
+    if (base.isEmpty()) {
+        base = QFileInfo("/dev/shm").isWritable() ? QString("/dev/shm") : QDir::tempPath();
+    }
+    dir.reset(new QTemporaryDir(base + "/disomaster-bench-XXXXXX"));
+    QVERIFY(dir->isValid());
+    if (qEnvironmentVariableIsSet("DISOMASTERBENCH_SIZE")) {
+        imagesize = qEnvironmentVariableIntValue("DISOMASTERBENCH_SIZE") * qint64(1 << 20);
+    }
+    fprintf(stderr, "running in %s, image size %lld MiB\n", dir->path().toUtf8().data(), imagesize >> 20);
+
+    //the image written, dumped and checked below
+    QDir(dir->path()).mkdir("image");
+    QFile f(path("image/payload"));
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    QByteArray chunk(1 << 20, Qt::Uninitialized);
+    for (int i = 0; i < chunk.size(); ++i) {
+        chunk[i] = char(i * 131);
+    }
+    for (qint64 done = 0; done < imagesize; done += chunk.size()) {
+        QVERIFY(f.write(chunk) == chunk.size());
+    }
+    f.close();
+
+    DISOMaster x;
+    x.stageFiles({ { QUrl(path("image")), QUrl("/") } });
+    QVERIFY(x.buildImage(QUrl::fromLocalFile(path("source.iso"))));
+    QVERIFY(QFile::remove(path("image/payload")));
+
+    //the drive holds the image from the start, for benchmarks run on their own
+    QVERIFY(QFile::copy(path("source.iso"), path("drive.iso")));
+}
+
+QString BenchDISOMaster::path(const QString &name) const
+{
+    return dir->filePath(name);
+}
+
+QString BenchDISOMaster::drive() const
+{
+    return "stdio:" + path("drive.iso");
+}
+
+// the recorded output of a burn
+static QStringList loadMessages()
+{
+    QFile f(QFINDTESTDATA("../tests/data/xorriso-messages.log"));
+    QStringList ret;
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return ret;
+    }
+    while (!f.atEnd()) {
+        ret.push_back(QString(f.readLine()).trimmed());
+    }
+    return ret;
+}
+
+void BenchDISOMaster::bench_commit_data()
+{
+    QTest::addColumn<int>("files");
+    QTest::addColumn<int>("filesize");
+    QTest::newRow("tiny files") << 20000 << 1024;
+    QTest::newRow("huge files") << 2 << (128 << 20);
+}
+
+void BenchDISOMaster::bench_commit()
+{
+    QFETCH(int, files);
+    QFETCH(int, filesize);
+
+    QDir(dir->path()).mkdir("commit");
+    const QByteArray content(filesize, 'c');
+    for (int i = 0; i < files; ++i) {
+        QFile f(path(QString("commit/f%1").arg(i)));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(content);
+    }
+
+    DISOMaster x;
+    QVERIFY(x.acquireDevice("stdio:" + path("commit.iso")));
+    x.stageFiles({ { QUrl(path("commit")), QUrl("/commit") } });
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(x.commit(BurnOptions(RockRidgeSupport)));
+    const qint64 ns = qMax<qint64>(timer.nsecsElapsed(), 1);
+    x.releaseDevice();
+
+    const qint64 bytes = qint64(files) * filesize;
+    fprintf(stderr, "%d x %d bytes: %.0f files/sec, tree built in %lld ms\n",
+            files, filesize, files * 1e9 / ns, x.lastJobResult().treebuildtime);
+    QTest::setBenchmarkResult(bytes * 1e9 / ns, QTest::BytesPerSecond);
+
+    QDir(path("commit")).removeRecursively();
+    QFile::remove(path("commit.iso"));
+}
+
+void BenchDISOMaster::bench_writeISO()
+{
+    const qint64 size = QFileInfo(path("source.iso")).size();
+    QVERIFY(size > 0);
+
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(drive()));
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(x.writeISO(QUrl::fromLocalFile(path("source.iso"))));
+    const qint64 ns = qMax<qint64>(timer.nsecsElapsed(), 1);
+    x.releaseDevice();
+
+    fprintf(stderr, "%lld bytes, lowest fifo %d%%\n", size, x.lastJobResult().minfifo);
+    QTest::setBenchmarkResult(size * 1e9 / ns, QTest::BytesPerSecond);
+}
+
+void BenchDISOMaster::bench_dumpISO()
+{
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(drive()));
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(x.dumpISO(QUrl::fromLocalFile(path("dump.iso")), DumpMD5));
+    const qint64 ns = qMax<qint64>(timer.nsecsElapsed(), 1);
+    x.releaseDevice();
+
+    const qint64 size = x.lastJobResult().dumpsize;
+    QVERIFY(size > 0);
+    QTest::setBenchmarkResult(size * 1e9 / ns, QTest::BytesPerSecond);
+    QFile::remove(path("dump.iso"));
+}
+
+void BenchDISOMaster::bench_checkMedia()
+{
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(drive()));
+    const qint64 blocks = qint64(x.getDeviceProperty(CapacityField).datablocks);
+    QVERIFY(blocks > 0);
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(x.checkmediaRange(0));
+    const qint64 ns = qMax<qint64>(timer.nsecsElapsed(), 1);
+    x.releaseDevice();
+
+    fprintf(stderr, "%lld blocks, good %.1f%%\n", blocks, x.lastJobResult().qgood * 100);
+    QTest::setBenchmarkResult(blocks * 2048 * 1e9 / ns, QTest::BytesPerSecond);
+}
+
+void BenchDISOMaster::bench_firstCommand_data()
+{
+    QTest::addColumn<int>("idlelimit");
+    QTest::newRow("new handles") << 0;
+    QTest::newRow("pooled handles") << 4;
+}
+
+// from construction to a drive ready for the first command
+void BenchDISOMaster::bench_firstCommand()
+{
+    QFETCH(int, idlelimit);
+
+    DISOMaster::setIdleHandleLimit(idlelimit);
+    DISOMaster::prewarmHandles(1);
+    qint64 construct = 0;
+    qint64 acquire = 0;
+    int runs = 0;
+    QBENCHMARK {
+        DISOMaster x;
+        QVERIFY(x.acquireDevice(drive()));
+        construct += x.constructionLatency();
+        acquire += x.acquireLatency();
+        ++runs;
+        x.releaseDevice();
+    }
+    fprintf(stderr, "construction %lld us, acquire %lld us\n", construct / runs, acquire / runs);
+    DISOMaster::setIdleHandleLimit(4);
+}
+
+void BenchDISOMaster::bench_deviceProperty_data()
+{
+    QTest::addColumn<int>("fields");
+    QTest::newRow("media type") << int(MediaTypeField);
+    QTest::newRow("capacity") << int(CapacityField);
+    QTest::newRow("all fields") << int(AllFields);
+}
+
+void BenchDISOMaster::bench_deviceProperty()
+{
+    QFETCH(int, fields);
+
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(drive()));
+    QBENCHMARK {
+        x.nullifyDevicePropertyCache(x.currentDevice());
+        x.getDeviceProperty(DevicePropertyFields(fields));
+    }
+    x.releaseDevice();
+}
+
+void BenchDISOMaster::bench_spanPlanner_data()
+{
+    QTest::addColumn<bool>("measured");
+    QTest::newRow("estimate") << false;
+    QTest::newRow("measured") << true;
+}
+
+// packing on the estimate alone, then with every disc measured exactly
+void BenchDISOMaster::bench_spanPlanner()
+{
+    QFETCH(bool, measured);
+
+    int files = 100000;
+    if (qEnvironmentVariableIsSet("DISOMASTERBENCH_FILES")) {
+        files = qEnvironmentVariableIntValue("DISOMASTERBENCH_FILES");
+    }
+    //sparse files of 1 KiB to 64 MiB, 100 per directory
+    QDir(dir->path()).mkdir("span");
+    for (int i = 0; i < files; ++i) {
+        if (i % 100 == 0) {
+            QDir(path("span")).mkdir(QString::number(i / 100));
+        }
+        QFile f(path(QString("span/%1/f%2").arg(i / 100).arg(i)));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        QVERIFY(f.resize(qint64(1024) << (i % 17)));
+    }
+    const QList<StagingTree::Entry> entries { { path("span"), "/span" } };
+    const qint64 dvd = qint64(4700) * 1000 * 1000;
+
+    int discs = 0;
+    if (measured) {
+        DISOMaster x;
+        x.stageFiles({ { QUrl(path("span")), QUrl("/span") } });
+        QBENCHMARK_ONCE {
+            discs = x.planSpanning(dvd, KeepDirectories, RockRidgeSupport | JolietSupport).size();
+        }
+    } else {
+        QBENCHMARK_ONCE {
+            discs = SpanPlanner::plan(entries, dvd, KeepDirectories).size();
+        }
+    }
+    QVERIFY(discs > 0);
+    fprintf(stderr, "%d files on %d DVDs\n", files, discs);
+    QDir(path("span")).removeRecursively();
+}
+
+void BenchDISOMaster::bench_parseMessages_data()
+{
+    QTest::addColumn<bool>("log");
+    QTest::newRow("classify") << false;
+    QTest::newRow("classify and log") << true;
+}
+
+// one pass over the recorded output of a burn
+void BenchDISOMaster::bench_parseMessages()
+{
+    QFETCH(bool, log);
+
+    const QStringList msgs = loadMessages();
+    QVERIFY(!msgs.isEmpty());
+
+    MessageLog ring;
+    QBENCHMARK {
+        for (const QString &msg : msgs) {
+            XorrisoMessage::classify(msg);
+            if (log) {
+                ring.append(MessageLog::parse(1, msg));
+            }
+        }
+        ring.discard();
+    }
+}
+
+void BenchDISOMaster::bench_classifyMessages_data()
+{
+    QTest::addColumn<bool>("legacy");
+    QTest::newRow("legacy") << true;
+    QTest::newRow("classifier") << false;
+}
+
+void BenchDISOMaster::bench_classifyMessages()
+{
+    QFETCH(bool, legacy);
+    const QStringList log = loadMessages();
+    QVERIFY(!log.isEmpty());
+
+    QElapsedTimer t;
+    qint64 count = 0;
+    t.start();
+    QBENCHMARK {
+        for (const QString &msg : log) {
+            if (legacy) {
+                legacyClassify(msg);
+            } else {
+                XorrisoMessage::classify(msg);
+            }
+        }
+        count += log.size();
+    }
+    const qint64 ns = qMax<qint64>(t.nsecsElapsed(), 1);
+    fprintf(stderr, "%s: %.0f messages/sec\n", legacy ? "legacy" : "classifier", count * 1e9 / ns);
+}
+
+void BenchDISOMaster::bench_buildImage_data()
+{
+    QTest::addColumn<int>("files");
+    QTest::addColumn<int>("filesize");
+    QTest::newRow("small files") << 4000 << (16 << 10);
+    QTest::newRow("large files") << 2 << (128 << 20);
+}
+
+void BenchDISOMaster::bench_buildImage()
+{
+    QFETCH(int, files);
+    QFETCH(int, filesize);
+
+    QDir(dir->path()).mkdir("build");
+    const QByteArray content(filesize, 'b');
+    for (int i = 0; i < files; ++i) {
+        QFile f(path(QString("build/f%1").arg(i)));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(content);
+    }
+
+    DISOMaster x;
+    x.stageFiles({ { QUrl(path("build")), QUrl("/data") } });
+    JobResult res;
+    QBENCHMARK_ONCE {
+        QVERIFY(x.buildImage(QUrl::fromLocalFile(path("build.iso")), RockRidgeSupport));
+        res = x.lastJobResult();
+    }
+    fprintf(stderr, "%d x %d bytes: %.1f MB/s, tree built in %lld ms, total %lld ms\n",
+            files, filesize, res.throughput / 1e6, res.treebuildtime, res.elapsed);
+
+    QDir(path("build")).removeRecursively();
+    QFile::remove(path("build.iso"));
+}
+
+void BenchDISOMaster::bench_fifoSize_data()
+{
+    QTest::addColumn<int>("fifo");
+    QTest::newRow("1 MiB") << (1 << 20);
+    QTest::newRow("4 MiB") << (4 << 20);
+    QTest::newRow("16 MiB") << (16 << 20);
+    QTest::newRow("64 MiB") << (64 << 20);
+}
+
+void BenchDISOMaster::bench_fifoSize()
+{
+    QFETCH(int, fifo);
+
+    QDir(dir->path()).mkdir("fifo");
+    const QByteArray content(64 << 20, 'f');
+    for (int i = 0; i < 4; ++i) {
+        QFile f(path(QString("fifo/f%1").arg(i)));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(content);
+    }
+
+    DISOMaster x;
+    WriteSettings ws;
+    ws.fifosize = fifo;
+    x.setWriteSettings(ws);
+    QVERIFY(x.acquireDevice("stdio:" + path("fifo.iso")));
+    x.stageFiles({ { QUrl(path("fifo")), QUrl("/data") } });
+    qint64 ms = 0;
+    QBENCHMARK_ONCE {
+        QVERIFY(x.commit(BurnOptions(RockRidgeSupport)));
+        ms = x.lastJobResult().elapsed;
+    }
+    x.releaseDevice();
+    fprintf(stderr, "fifo %d MiB: %lld ms, %.1f MB/s, lowest fifo %d%%\n", fifo >> 20, ms,
+            (256 << 20) / 1e3 / qMax<qint64>(ms, 1), x.lastJobResult().minfifo);
+
+    QDir(path("fifo")).removeRecursively();
+    QFile::remove(path("fifo.iso"));
+}
+
+void BenchDISOMaster::bench_stagingTree()
+{
+    const int n = 100;
+    QVector<StagingTree::Entry> entries;
+    entries.reserve(n * n * n);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            for (int k = 0; k < n; ++k) {
+                const QString rel = QString("d%1/s%2/f%3").arg(i).arg(j).arg(k);
+                entries.push_back(StagingTree::Entry("/data/" + rel, "/" + rel));
+            }
+        }
+    }
+    std::shuffle(entries.begin(), entries.end(), std::mt19937(42));
+
+    QBENCHMARK_ONCE {
+        StagingTree t;
+        QElapsedTimer timer;
+        timer.start();
+        t.insert(entries);
+        const qint64 tstage = timer.restart();
+        const int count = t.entries(true).size();
+        const qint64 titer = timer.restart();
+        int removed = 0;
+        for (int i = 0; i < n; ++i) {
+            removed += t.removeTree(QString("/data/d%1").arg(i));
+        }
+        const qint64 tremove = timer.restart();
+        QCOMPARE(count, n * n * n);
+        QCOMPARE(removed, n * n * n);
+        QVERIFY(t.isEmpty());
+        fprintf(stderr, "%d entries: stage %lld ms, iterate %lld ms, remove %lld ms\n",
+                count, tstage, titer, tremove);
+    }
+
+    //what staging them through the API holds
+    QHash<QUrl, QUrl> files;
+    files.reserve(entries.size());
+    for (const StagingTree::Entry &e : entries) {
+        files.insert(QUrl(e.first), QUrl(e.second));
+    }
+    DISOMaster x;
+    x.stageFiles(files);
+    qInfo("%d entries: %llu bytes staged", int(files.size()), x.stagingMemoryUsage());
+}
+
+QTEST_MAIN(BenchDISOMaster)
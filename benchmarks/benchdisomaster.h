@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef BENCHDISOMASTER_H
+#define BENCHDISOMASTER_H
+
+#include <QObject>
+#include <QtTest/QtTest>
+#include "../libdisomaster/disomaster.h"
+
+/*
+ * Benchmarks on libburn stdio: pseudo-drives, so they run anywhere
+ * without a real drive. Each one reports a single figure through
+ * QTest, use "-o results.csv,csv" or "-o results.xml,xml" to get them
+ * in machine-readable form.
+ */
+class BenchDISOMaster : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BenchDISOMaster(QObject *parent = nullptr);
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void bench_commit_data();
+    void bench_commit();
+    void bench_writeISO();
+    void bench_dumpISO();
+    void bench_checkMedia();
+    void bench_firstCommand_data();
+    void bench_firstCommand();
+    void bench_deviceProperty_data();
+    void bench_deviceProperty();
+    void bench_spanPlanner_data();
+    void bench_spanPlanner();
+    void bench_parseMessages_data();
+    void bench_parseMessages();
+    void bench_classifyMessages_data();
+    void bench_classifyMessages();
+    void bench_buildImage_data();
+    void bench_buildImage();
+    void bench_fifoSize_data();
+    void bench_fifoSize();
+    void bench_stagingTree();
+
+private:
+    QString path(const QString &name) const;
+    QString drive() const;
+
+    QScopedPointer<QTemporaryDir> dir;
+    qint64 imagesize;
+};
+
+#endif // BENCHDISOMASTER_H
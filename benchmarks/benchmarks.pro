@@ -0,0 +1,11 @@
+QT += testlib
+QT -= gui
+CONFIG += NO_KEYWORDS
+TARGET = benchdisomaster
+LIBS += ../libdisomaster/libdisomaster.so
+HEADERS += \
+    ../tests/legacyclassify.h \
+    benchdisomaster.h
+
+SOURCES += \
+    benchdisomaster.cpp
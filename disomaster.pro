@@ -4,5 +4,9 @@ CONFIG += NO_KEYWORDS
 SUBDIRS = libdisomaster
 
 BUILD_TESTS {
-        SUBDIRS += tests
+        SUBDIRS += simulatedio tests
+}
+
+BUILD_BENCHMARKS {
+        SUBDIRS += benchmarks
 }
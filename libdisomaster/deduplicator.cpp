@@ -0,0 +1,166 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "deduplicator.h"
+#include <QCryptographicHash>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <sys/stat.h>
+
+namespace DISOMasterNS {
+
+QMutex Deduplicator::cachelock;
+QCache<Deduplicator::FileKey, QByteArray> Deduplicator::cache(Deduplicator::CacheLimit);
+
+uint qHash(const Deduplicator::FileKey &k, uint seed)
+{
+    return qHash(k.ino, seed) ^ qHash(k.mtime, seed) ^ qHash(k.ctime, seed) ^ uint(k.dev) ^ uint(k.size);
+}
+
+namespace {
+struct StagedFile
+{
+    QString source;
+    QString target;
+    qint64 size;
+    QByteArray digest;
+};
+}
+
+/*!
+ * \brief Find the staged files whose content is already staged elsewhere.
+ * \param entries staged entries (local path, on-disc path), directories are walked.
+ * \param threads number of hashing threads, 0 for one per core.
+ * \return the duplicates, each with the first file (in on-disc path order)
+ * of the same content as its original.
+ */
+QList<Deduplicator::Duplicate> Deduplicator::find(const QList<StagingTree::Entry> &entries, int threads)
+{
+    QVector<StagedFile> files;
+    for (const StagingTree::Entry &e : entries) {
+        const QFileInfo fi(e.first);
+        if (fi.isFile() && !fi.isSymLink()) {
+            files.push_back({ e.first, e.second, fi.size(), QByteArray() });
+            continue;
+        }
+        if (!fi.isDir() || fi.isSymLink()) {
+            continue;
+        }
+        const QString root = e.first.endsWith('/') ? e.first : e.first + '/';
+        const QString target = e.second.endsWith('/') ? e.second : e.second + '/';
+        QDirIterator it(e.first, QDir::Files | QDir::Hidden | QDir::System | QDir::NoSymLinks, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const QString path = it.next();
+            files.push_back({ path, target + path.mid(root.size()), it.fileInfo().size(), QByteArray() });
+        }
+    }
+
+    //a size nobody else has cannot be duplicated: no need to read it
+    QHash<qint64, int> sizes;
+    for (const StagedFile &f : files) {
+        ++sizes[f.size];
+    }
+    QVector<StagedFile *> candidates;
+    for (StagedFile &f : files) {
+        if (f.size > 0 && sizes.value(f.size) > 1) {
+            candidates.push_back(&f);
+        }
+    }
+
+    std::atomic<int> next(0);
+    const int nthreads = qMin(threads > 0 ? threads : QThread::idealThreadCount(), candidates.size());
+    std::vector<std::thread> workers;
+    for (int i = 0; i < nthreads; ++i) {
+        workers.emplace_back([&candidates, &next] {
+            for (int j = next++; j < candidates.size(); j = next++) {
+                candidates[j]->digest = digest(candidates[j]->source);
+            }
+        });
+    }
+    for (auto &t : workers) {
+        t.join();
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const StagedFile *a, const StagedFile *b) {
+        return StagingTree::pathLessThan(a->target, b->target);
+    });
+    QHash<QPair<qint64, QByteArray>, const StagedFile *> originals;
+    QList<Duplicate> ret;
+    for (const StagedFile *f : candidates) {
+        if (f->digest.isEmpty()) {
+            continue;
+        }
+        const QPair<qint64, QByteArray> key(f->size, f->digest);
+        if (const StagedFile *orig = originals.value(key)) {
+            ret.push_back({ f->target, orig->target, f->size, f->source });
+        } else {
+            originals.insert(key, f);
+        }
+    }
+    return ret;
+}
+
+/*!
+ * \brief SHA-256 of a file, from the cache if it did not change since.
+ * \return the digest, empty if the file could not be read.
+ */
+QByteArray Deduplicator::digest(const QString &path)
+{
+    FileKey key;
+    if (!fileKey(path, key)) {
+        return QByteArray();
+    }
+    {
+        QMutexLocker locker(&cachelock);
+        if (const QByteArray *cached = cache.object(key)) {
+            return *cached;
+        }
+    }
+
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    QByteArray buf(1 << 20, Qt::Uninitialized);
+    qint64 n;
+    while ((n = f.read(buf.data(), buf.size())) > 0) {
+        hash.addData(buf.constData(), int(n));
+    }
+    if (n < 0) {
+        return QByteArray();
+    }
+    const QByteArray ret = hash.result();
+
+    QMutexLocker locker(&cachelock);
+    cache.insert(key, new QByteArray(ret));
+    return ret;
+}
+
+int Deduplicator::cacheSize()
+{
+    QMutexLocker locker(&cachelock);
+    return cache.size();
+}
+
+bool Deduplicator::fileKey(const QString &path, FileKey &key)
+{
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0) {
+        return false;
+    }
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.mtime = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    key.ctime = qint64(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+    key.size = st.st_size;
+    return true;
+}
+
+}
@@ -0,0 +1,64 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DEDUPLICATOR_H
+#define DEDUPLICATOR_H
+
+#include "stagingtree.h"
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Finds staged files with identical content.
+ *
+ * Only files sharing their size with another one are hashed, in
+ * parallel. Digests are kept in a process-wide cache keyed by
+ * (device, inode, mtime, ctime, size), so staging the same set again
+ * does not read it again. The cache holds the CacheLimit most recently
+ * used digests.
+ */
+class Deduplicator
+{
+public:
+    struct Duplicate
+    {
+        QString target;     // on-disc path of the copy
+        QString original;   // on-disc path of the file it duplicates
+        qint64 size;
+        QString source;     // local path of the copy
+    };
+
+    static const int CacheLimit = 1 << 16;
+
+    static QList<Duplicate> find(const QList<StagingTree::Entry> &entries, int threads = 0);
+    static QByteArray digest(const QString &path);
+    static int cacheSize();
+
+private:
+    struct FileKey
+    {
+        quint64 dev;
+        quint64 ino;
+        qint64 mtime;       // nanoseconds
+        qint64 ctime;       // nanoseconds, changes with content restored under an old mtime
+        qint64 size;
+        bool operator==(const FileKey &o) const
+        {
+            return dev == o.dev && ino == o.ino && mtime == o.mtime && ctime == o.ctime && size == o.size;
+        }
+    };
+    friend uint qHash(const FileKey &k, uint seed);
+
+    static bool fileKey(const QString &path, FileKey &key);
+
+    static QMutex cachelock;
+    static QCache<FileKey, QByteArray> cache;
+};
+
+}
+
+#endif // DEDUPLICATOR_H
@@ -0,0 +1,133 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "devicemonitor.h"
+#include "disomaster.h"
+#include <QHash>
+#include <QList>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace DISOMasterNS {
+
+//major number of SCSI CD-ROM block devices (/dev/srN)
+static const char *const kSrMajor = "11";
+
+Q_GLOBAL_STATIC(DeviceMonitor, monitor)
+
+DeviceMonitor::DeviceMonitor()
+    : sock(-1), stopfd(-1)
+{
+    sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (sock < 0) {
+        return;
+    }
+
+    struct sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1; //kernel uevents
+    stopfd = eventfd(0, EFD_CLOEXEC);
+    if (stopfd < 0 || bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+        ::close(sock);
+        sock = -1;
+        return;
+    }
+
+    thread = std::thread([this] { run(); });
+}
+
+DeviceMonitor::~DeviceMonitor()
+{
+    if (thread.joinable()) {
+        const quint64 one = 1;
+        if (::write(stopfd, &one, sizeof(one)) == sizeof(one)) {
+            thread.join();
+        } else {
+            thread.detach();
+        }
+    }
+    if (sock >= 0) {
+        ::close(sock);
+    }
+    if (stopfd >= 0) {
+        ::close(stopfd);
+    }
+}
+
+/*!
+ * \brief The monitor shared by all DISOMaster instances, started on first use.
+ */
+DeviceMonitor *DeviceMonitor::instance()
+{
+    return monitor();
+}
+
+/*!
+ * \brief Whether events are delivered (the netlink socket could be opened).
+ */
+bool DeviceMonitor::isRunning() const
+{
+    return thread.joinable();
+}
+
+void DeviceMonitor::run()
+{
+    QByteArray buf(16 << 10, Qt::Uninitialized);
+    struct pollfd fds[2] = { { sock, POLLIN, 0 }, { stopfd, POLLIN, 0 } };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        const ssize_t n = recv(sock, buf.data(), size_t(buf.size()), 0);
+        if (n > 0) {
+            handleUevent(QByteArray::fromRawData(buf.constData(), int(n)));
+        }
+    }
+}
+
+/*
+ * "change@/devices/.../block/sr0\0ACTION=change\0DEVNAME=sr0\0
+ *  SUBSYSTEM=block\0MAJOR=11\0DISK_MEDIA_CHANGE=1\0..."
+ */
+void DeviceMonitor::handleUevent(const QByteArray &buf)
+{
+    QHash<QByteArray, QByteArray> env;
+    const QList<QByteArray> lines = buf.split('\0');
+    for (int i = 1; i < lines.size(); ++i) {
+        const int eq = lines[i].indexOf('=');
+        if (eq > 0) {
+            env.insert(lines[i].left(eq), lines[i].mid(eq + 1));
+        }
+    }
+    if (env.value("SUBSYSTEM") != "block" || env.value("MAJOR") != kSrMajor || env.value("DEVNAME").isEmpty()) {
+        return;
+    }
+
+    const QByteArray action = env.value("ACTION");
+    int event;
+    if (action == "add") {
+        event = DISOMaster::DeviceAdded;
+    } else if (action == "remove") {
+        event = DISOMaster::DeviceRemoved;
+    } else if (action == "change" && env.contains("DISK_MEDIA_CHANGE")) {
+        event = DISOMaster::MediaChanged;
+    } else {
+        return;
+    }
+
+    const QByteArray devname = env.value("DEVNAME");
+    Q_EMIT deviceEvent(devname.startsWith('/') ? QString(devname) : "/dev/" + QString(devname), event);
+}
+
+}
@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DEVICEMONITOR_H
+#define DEVICEMONITOR_H
+
+#include <QObject>
+#include <thread>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Process-wide watcher for optical drive hot-plug and media change.
+ *
+ * Listens to kernel uevents on a netlink socket from a background
+ * thread. deviceEvent is emitted from that thread.
+ */
+class DeviceMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    DeviceMonitor();
+    ~DeviceMonitor();
+
+    static DeviceMonitor *instance();
+    bool isRunning() const;
+
+Q_SIGNALS:
+    /**
+     * \brief A drive was added, removed, or its media changed.
+     * \param devnode device node, e.g. "/dev/sr0"
+     * \param event a DISOMaster::DeviceEvent
+     */
+    void deviceEvent(QString devnode, int event);
+
+private:
+    int sock;
+    int stopfd;
+    std::thread thread;
+
+    void run();
+    void handleUevent(const QByteArray &buf);
+};
+
+}
+
+#endif // DEVICEMONITOR_H
@@ -0,0 +1,170 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "devicescanner.h"
+#include "devicemonitor.h"
+#include "xorrisomessage.h"
+#include "xorrisopool.h"
+#include "xorriso.h"
+#include <QDir>
+#include <algorithm>
+#include <thread>
+
+#define PCHAR(s) (char *)(s)
+
+namespace DISOMasterNS {
+
+Q_GLOBAL_STATIC(DeviceScanner, scanner)
+
+DeviceScanner::DeviceScanner()
+    : scanned(false)
+{
+    QObject::connect(DeviceMonitor::instance(), &DeviceMonitor::deviceEvent, [this](const QString &devnode, int) {
+        invalidate(devnode);
+    });
+}
+
+DeviceScanner *DeviceScanner::instance()
+{
+    return scanner();
+}
+
+/*!
+ * \brief Get the drives in the system.
+ * \param refresh probe new drives and drives with pending events
+ * (the first call always does).
+ *
+ * The cache is not locked while the drives are probed, so events
+ * from the device monitor are never held up by a slow drive.
+ */
+QList<DeviceInfo> DeviceScanner::devices(bool refresh)
+{
+    {
+        QMutexLocker locker(&lock);
+        if (scanned && !refresh) {
+            return sorted();
+        }
+    }
+
+    QMutexLocker scanlocker(&scanlock);
+    const QStringList found = candidates();
+    QStringList toprobe;
+    {
+        QMutexLocker locker(&lock);
+        for (const QString &dev : found) {
+            if (!cache.contains(dev) || dirty.contains(dev)) {
+                toprobe.push_back(dev);
+            }
+        }
+        for (auto it = cache.begin(); it != cache.end();) {
+            it = found.contains(it.key()) ? it + 1 : cache.erase(it);
+        }
+        //events from now on are for the next scan
+        dirty.clear();
+    }
+
+    QVector<DeviceInfo> probed(toprobe.size());
+    std::vector<std::thread> threads;
+    for (int i = 0; i < toprobe.size(); ++i) {
+        threads.emplace_back([&probed, &toprobe, i] { probed[i] = probe(toprobe[i]); });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    QMutexLocker locker(&lock);
+    for (const DeviceInfo &info : probed) {
+        //a drive held by someone else keeps what we knew about it
+        if (info.available || !cache.contains(info.devid)) {
+            cache.insert(info.devid, info);
+        } else {
+            cache[info.devid].available = false;
+        }
+    }
+    scanned = true;
+    return sorted();
+}
+
+void DeviceScanner::invalidate(const QString &devnode)
+{
+    QMutexLocker locker(&lock);
+    dirty.insert(devnode);
+}
+
+// the cached drives by device identifier, with lock held
+QList<DeviceInfo> DeviceScanner::sorted() const
+{
+    QList<DeviceInfo> ret = cache.values();
+    std::sort(ret.begin(), ret.end(), [](const DeviceInfo &a, const DeviceInfo &b) {
+        return a.devid < b.devid;
+    });
+    return ret;
+}
+
+/*!
+ * \brief Device nodes of the optical drives, without touching the drives.
+ */
+QStringList DeviceScanner::candidates()
+{
+    QStringList ret;
+    const QStringList names = QDir("/sys/class/block").entryList({ "sr*" }, QDir::AllEntries | QDir::System);
+    for (const QString &name : names) {
+        ret.push_back("/dev/" + name);
+    }
+    if (ret.isEmpty()) {
+        for (const QString &name : QDir("/dev").entryList({ "sr*" }, QDir::System)) {
+            ret.push_back("/dev/" + name);
+        }
+    }
+    return ret;
+}
+
+/*!
+ * \brief Identify a drive and the media in it, using a handle leased from the pool.
+ *
+ * The drive is acquired as output drive only, so no image is loaded.
+ */
+DeviceInfo DeviceScanner::probe(const QString &devnode)
+{
+    DeviceInfo ret;
+    ret.devid = devnode;
+
+    XorrisoPool::Handle *h = XorrisoPool::instance()->lease(nullptr, nullptr);
+    if (!h) {
+        return ret;
+    }
+    XorrisO *x = h->xorriso;
+
+    Xorriso_set_problem_status(x, PCHAR(""), 0);
+    int r = Xorriso_option_dev(x, devnode.toUtf8().data(), 2);
+    r = Xorriso_eval_problem_status(x, r, 0);
+    if (r > 0) {
+        ret.available = true;
+
+        int ac, avail;
+        char **av = nullptr;
+        Xorriso_sieve_get_result(x, PCHAR("Drive type   :"), &ac, &av, &avail, 1);
+        if (ac >= 3) {
+            ret.vendor = QString(av[0]).trimmed();
+            ret.product = QString(av[1]).trimmed();
+            ret.revision = QString(av[2]).trimmed();
+        }
+        Xorriso__dispose_words(&ac, &av);
+
+        Xorriso_sieve_get_result(x, PCHAR("Media current:"), &ac, &av, &avail, 1);
+        if (ac >= 1) {
+            const QString mt = QString(av[0]);
+            ret.hasmedia = !mt.startsWith("is not present") && !mt.startsWith("none");
+            ret.media = ret.hasmedia ? mediaTypeFromString(mt) : MediaType::NoMedia;
+        }
+        Xorriso__dispose_words(&ac, &av);
+
+        Xorriso_option_end(x, 1);
+    }
+
+    XorrisoPool::instance()->giveBack(h);
+    return ret;
+}
+
+}
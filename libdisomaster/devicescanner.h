@@ -0,0 +1,46 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DEVICESCANNER_H
+#define DEVICESCANNER_H
+
+#include "disomaster.h"
+#include <QMutex>
+#include <QSet>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Process-wide cache of the optical drives in the system.
+ *
+ * Drives are probed in parallel, one xorriso handle each, so a scan
+ * takes as long as the slowest drive. Drives reported by the device
+ * monitor are probed again on the next scan; the others are served
+ * from the cache.
+ */
+class DeviceScanner
+{
+public:
+    DeviceScanner();
+
+    static DeviceScanner *instance();
+    QList<DeviceInfo> devices(bool refresh);
+    void invalidate(const QString &devnode);
+
+    static QStringList candidates();
+    static DeviceInfo probe(const QString &devnode);
+
+private:
+    QList<DeviceInfo> sorted() const;
+
+    QMutex scanlock;    // one scan at a time
+    QMutex lock;        // cache, dirty and scanned, never held while probing
+    QHash<QString, DeviceInfo> cache;
+    QSet<QString> dirty;
+    bool scanned;
+};
+
+}
+
+#endif // DEVICESCANNER_H
@@ -3,8 +3,45 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "disomaster.h"
+#include "deduplicator.h"
+#include "devicemonitor.h"
+#include "devicescanner.h"
+#include "dumpfollower.h"
+#include "mediaprofiles.h"
+#include "messagelog.h"
+#include "spanplanner.h"
+#include "stagingtree.h"
+#include "trackpipe.h"
+#include "watcherchannel.h"
+#include "xorrisomessage.h"
+#include "xorrisopool.h"
 #include "xorriso.h"
-#include <QRegularExpression>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QRunnable>
+#include <QSet>
+#include <QTemporaryFile>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+#include <QWaitCondition>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define PCHAR(s) (char *)(s)
 
@@ -13,36 +50,204 @@
     r = Xorriso_option_##opt(x, __VA_ARGS__);    \
     r = Xorriso_eval_problem_status(x, r, 0);
 
-#define JOBFAILED_IF(r, x)                              \
-    if (r <= 0) {                                       \
-        Xorriso_option_end(x, 1);                       \
-        Q_EMIT jobStatusChanged(JobStatus::Failed, -1); \
-        return false;                                   \
+#define JOBCANCELLED_IF_REQUESTED()                         \
+    if (d->cancelrequested) {                               \
+        d->teardown();                                      \
+        Q_EMIT jobStatusChanged(JobStatus::Cancelled, -1);  \
+        return false;                                       \
     }
 
-int XorrisoResultHandler(void *handle, char *text);
-int XorrisoInfoHandler(void *handle, char *text);
+#define JOBFAILED_IF(r, x)                                  \
+    if (r <= 0) {                                           \
+        JOBCANCELLED_IF_REQUESTED()                         \
+        Xorriso_option_end(x, 1);                           \
+        d->endJob(false);                                   \
+        Q_EMIT jobStatusChanged(JobStatus::Failed, -1);     \
+        return false;                                       \
+    }
 
 namespace DISOMasterNS {
 
+class JobRunnable : public QRunnable
+{
+public:
+    explicit JobRunnable(std::function<void()> f)
+        : func(f) {}
+    void run() override { func(); }
+
+private:
+    std::function<void()> func;
+};
+
+static qint64 steadyMSecs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static MediaRegion::Quality regionQualityFromString(const char *q)
+{
+    switch (q[0]) {
+    case '-':
+        return MediaRegion::Bad;
+    case '0':
+        return MediaRegion::Untested;
+    default:
+        return strstr(q, "slow") ? MediaRegion::Slow : MediaRegion::Good;
+    }
+}
+
+/*
+ * Insert a region into a sorted, non-overlapping list,
+ * merging it with adjacent regions of the same quality.
+ */
+static void addMediaRegion(QList<MediaRegion> &map, const MediaRegion &region)
+{
+    auto it = std::lower_bound(map.begin(), map.end(), region.start, [](const MediaRegion &a, qint64 start) {
+        return a.start < start;
+    });
+    it = map.insert(it, region);
+    auto next = it + 1;
+    if (next != map.end() && next->quality == it->quality && it->start + it->length == next->start) {
+        it->length += next->length;
+        map.erase(next);
+    }
+    if (it != map.begin()) {
+        auto prev = it - 1;
+        if (prev->quality == it->quality && prev->start + prev->length == it->start) {
+            prev->length += it->length;
+            map.erase(it);
+        }
+    }
+}
+
+/*
+ * The image tree of the disc measured last, on a handle of its own.
+ * When the same disc is measured again, files that moved off it are
+ * only removed from the tree instead of building it anew.
+ */
+struct PlanMeasure
+{
+    ~PlanMeasure() { drop(); }
+    void drop()
+    {
+        if (h) {
+            XorrisoPool::instance()->giveBack(h);
+        }
+        h = nullptr;
+        disc = 0;
+        paths.clear();
+    }
+
+    XorrisoPool::Handle *h = nullptr;
+    int disc = 0;
+    QSet<QString> paths;    //files and directories in the tree, the manifest aside
+    QTemporaryFile manifest;
+};
+
+class DISOMasterPrivate;
+
+/*
+ * Shared by an instance and its device monitor connection. The monitor
+ * thread delivers under lock, and the instance clears d under it, so
+ * no delivery is still running once d is gone.
+ */
+struct MonitorGuard
+{
+    QMutex lock;
+    DISOMasterPrivate *d = nullptr;
+};
+
 class DISOMasterPrivate
 {
 private:
     DISOMasterPrivate(DISOMaster *q)
-        : q_ptr(q) {}
-    XorrisO *xorriso;
-    QHash<QUrl, QUrl> files;
+        : q_ptr(q)
+    {
+        //one job at a time per drive, queued jobs run in order.
+        jobpool.setMaxThreadCount(1);
+        abortfile = QDir::tempPath() + QString("/disomaster-abort-%1-%2").arg(getpid()).arg(quintptr(this), 0, 16);
+    }
+    XorrisO *xorriso = nullptr;
+    XorrisoPool::Handle *pooled = nullptr;  //the handle xorriso belongs to, leased from the pool
+    qint64 constructlatency = 0;
+    qint64 acquirelatency = 0;
+    StagingTree files;
+    QList<SpanFile> spanparts;      //parts of split files staged by stageDiscPlan()
+    std::unique_ptr<QTemporaryFile> manifestfile;
     QHash<QString, DeviceProperty> dev;
-    QStringList xorrisomsg;
-    QString curdev;
-    QString curspeed;
+    QHash<QString, QHash<int, qint64>> devstamp; //per field group, msecs since epoch
+    mutable QReadWriteLock devlock;
+    qint64 propertylatency = 0;
+    //set by the job, read by the message watcher
+    std::atomic<qint64> scanbase { 0 };     //blocks of the checked range before the current check_media step
+    std::atomic<qint64> scantotal { 0 };    //blocks in the checked range
+    std::atomic<bool> verifying { false };  //commit with VerifyDatas: it is not finished once written
+    MessageLog log;
+    WatcherChannel watcher;
+    QString curdev;     //written under devlock, the device monitor reads it
+    QThreadPool jobpool;
+    QElapsedTimer jobtimer;
+    JobResult result;
+    WriteSettings writesettings;
+    QString profilekey;     //media profile the job result goes to, empty if none
+    std::atomic<int> burnedspeed { -1 };    //speed the disc in the drive was burnt at, -1 if unknown
+    //progress is updated by the message watcher, and read by anyone
+    mutable QMutex proglock;
+    JobProgress prog;
+    JobProgress progemitted;
+    QElapsedTimer progtimer;
+    int proginterval = 250;
+    int laststatus = -2;    //last jobStatusChanged from the watcher, to drop repeats (under proglock)
+    int lastprogress = -1;
+    //cancel() and pause() come from any thread
+    std::atomic<bool> jobrunning { false };
+    std::atomic<bool> pausable { false };   //checkmedia and dumpISO only
+    std::atomic<bool> cancelrequested { false };
+    std::atomic<bool> pauserequested { false };
+    std::atomic<bool> trackcut { false };   //writeISO(QIODevice *) fed less than the track size
+    bool mediajob = false;  //the job writes or blanks the media: its cached property is stale after it
+    std::atomic<qint64> cancelstamp { 0 };
+    QMutex pauselock;
+    QWaitCondition resumed;
+    QString abortfile;      //the abort_file of -check_media
+    std::shared_ptr<MonitorGuard> monitorguard;
     DISOMaster *q_ptr;
     Q_DECLARE_PUBLIC(DISOMaster)
 
-    void getCurrentDeviceProperty();
+    bool lease();
+    void giveBack();
+    void setCurrentDevice(const QString &devid);
+    void fetchDeviceProperty(DevicePropertyFields fields);
+    DeviceProperty deviceProperty(const QString &devid) const;
+    void setDeviceProperty(const QString &devid, const DeviceProperty &p, DevicePropertyFields fetched);
+    DevicePropertyFields cachedFields(const QString &devid) const;
+    QString profileKey();
+    int chooseWriteSpeed();
+    QString speedArgument(int speed);
+    void recordProfile(bool success);
+    int applyWriteSettings(const WriteSettings &ws);
+    void clearStaging();
+    int mapStagingFiles(const BurnOptions &opts);
+    qint64 measurePlan(PlanMeasure &m, const DiscPlan &plan, const BurnOptions &opts, const QString &volid);
+    int shareDuplicates();
+    int restoreAttributes(const QString &source, QByteArray &target);
+    qint64 lastSessionStart();
+    int countDelta(qint64 startlba);
+    int verifySession(qint64 startlba);
+    void beginJob(JobProgress::Phase phase);
+    void reportStatus(DISOMaster::JobStatus status, int progress);
+    void publishProgress(bool force);
+    void endJob(bool success);
+    void touchAbortFile();
+    void clearAbortFile();
+    void waitWhilePaused();
+    void teardown();
+    QFuture<JobResult> runJob(std::function<void()> job);
 
 public:
+    static void receive(void *owner, int channel, char *text);
     void messageReceived(int type, char *text);
+    void deviceEvent(const QString &devnode, int event);
 };
 
 /*!
@@ -52,39 +257,59 @@ public:
  * DISOMaster provides basic optical drive operation and on-disc
  * filesystem manipulation.
  *
- * All method calls in this class are synchronous: they do not
- * return until the operation completes. Note the signal is emitted
- * from a separate thread (while the job is actually running).
+ * Unless their name ends with "Async", all method calls in this
+ * class are synchronous: they do not return until the operation
+ * completes. Note the signal is emitted from a separate thread
+ * (while the job is actually running).
+ *
+ * The asynchronous variants queue the job on a worker thread owned
+ * by the instance and return immediately. Jobs of one instance run
+ * one after another in the order they were queued, so a whole
+ * sequence can be queued up front. Do not call synchronous methods
+ * while asynchronous jobs are still pending on the same instance.
  */
 DISOMaster::DISOMaster(QObject *parent)
     : QObject(parent),
       d_ptr(new DISOMasterPrivate(this))
 {
     Q_D(DISOMaster);
-    int r = Xorriso_new(&d->xorriso, PCHAR("xorriso"), 0);
-    if (r <= 0) {
-        d->xorriso = nullptr;
-        return;
-    }
+    QElapsedTimer timer;
+    timer.start();
 
-    r = Xorriso_startup_libraries(d->xorriso, 0);
-    if (r <= 0) {
-        Xorriso_destroy(&d->xorriso, 0);
+    qRegisterMetaType<MediaRegion>();
+    qRegisterMetaType<JobProgress>();
+
+    if (!d->lease()) {
         return;
     }
-
-    Xorriso_sieve_big(d->xorriso, 0);
-    Xorriso_start_msg_watcher(d->xorriso, XorrisoResultHandler, d, XorrisoInfoHandler, d, 0);
+    d->constructlatency = timer.nsecsElapsed() / 1000;
+
+    d->monitorguard = std::make_shared<MonitorGuard>();
+    d->monitorguard->d = d;
+    std::shared_ptr<MonitorGuard> guard = d->monitorguard;
+    connect(DeviceMonitor::instance(), &DeviceMonitor::deviceEvent, this, [guard](const QString &devnode, int event) {
+        QMutexLocker locker(&guard->lock);
+        if (guard->d) {
+            guard->d->deviceEvent(devnode, event);
+        }
+    }, Qt::DirectConnection);
 }
 
 DISOMaster::~DISOMaster()
 {
     Q_D(DISOMaster);
 
-    if (d->xorriso) {
-        Xorriso_stop_msg_watcher(d->xorriso, 0);
-        Xorriso_destroy(&d->xorriso, 0);
+    //the monitor thread may be delivering right now: wait for it, and
+    //keep it from calling into d once this returns
+    disconnect(DeviceMonitor::instance(), nullptr, this, nullptr);
+    if (d->monitorguard) {
+        QMutexLocker locker(&d->monitorguard->lock);
+        d->monitorguard->d = nullptr;
     }
+
+    d->jobpool.waitForDone();
+
+    d->giveBack();
 }
 
 /*!
@@ -105,15 +330,26 @@ bool DISOMaster::acquireDevice(QString dev)
     Q_D(DISOMaster);
 
     if (dev.length()) {
-        d->files.clear();
-        d->curdev = dev;
+        QElapsedTimer timer;
+        timer.start();
+        //the handle went back to the pool with the last releaseDevice()
+        if (!d->lease()) {
+            return false;
+        }
+        d->clearStaging();
+        d->burnedspeed = -1;
+        d->setCurrentDevice(dev);
+
+        //fresh sieve records for the new drive
+        Xorriso_sieve_clear_results(d->xorriso, 0);
 
         int r;
         XORRISO_OPT(dev, d->xorriso, dev.toUtf8().data(), 3);
         if (r <= 0) {
-            d->curdev = "";
+            d->setCurrentDevice("");
             return false;
         }
+        d->acquirelatency = timer.nsecsElapsed() / 1000;
         return true;
     }
 
@@ -122,13 +358,19 @@ bool DISOMaster::acquireDevice(QString dev)
 
 /*!
  * \brief Release the drive currently held.
+ *
+ * The xorriso handle goes back to the process-wide pool, reset, for
+ * the next DISOMaster to pick up. acquireDevice() leases one again.
  */
 void DISOMaster::releaseDevice()
 {
     Q_D(DISOMaster);
-    d->curdev = "";
-    d->files.clear();
-    Xorriso_option_end(d->xorriso, 0);
+    d->setCurrentDevice("");
+    d->clearStaging();
+    if (d->xorriso) {
+        Xorriso_option_end(d->xorriso, 0);
+    }
+    d->giveBack();
 }
 
 /*!
@@ -154,15 +396,117 @@ QString DISOMaster::currentDevice() const
 DeviceProperty DISOMaster::getDeviceProperty()
 {
     Q_D(DISOMaster);
-    d->getCurrentDeviceProperty();
-    return d->dev[d->curdev];
+    d->fetchDeviceProperty(AllFields);
+    return d->deviceProperty(d->curdev);
+}
+
+/*!
+ * \brief Get some fields of the property of the currently acquired device.
+ * \param fields the field groups wanted.
+ *
+ * Only the groups not cached yet are fetched from the drive. Media
+ * type, capacity, blank status and volume id are cheap; write speeds
+ * need a query of the drive and are only fetched when asked for.
+ * Other fields of the returned property hold whatever is cached.
+ *
+ * \return the property of the acquired device.
+ * \sa getDeviceProperty(), devicePropertyTimestamp()
+ */
+DeviceProperty DISOMaster::getDeviceProperty(DevicePropertyFields fields)
+{
+    Q_D(DISOMaster);
+    const DevicePropertyFields missing = fields & ~d->cachedFields(d->curdev);
+    d->propertylatency = 0;
+    if (missing) {
+        d->fetchDeviceProperty(missing);
+    }
+    return d->deviceProperty(d->curdev);
+}
+
+/*!
+ * \brief Get the time a field group of a device property was fetched.
+ * \return an invalid QDateTime if the group is not cached.
+ */
+QDateTime DISOMaster::devicePropertyTimestamp(QString dev, DevicePropertyField field) const
+{
+    Q_D(const DISOMaster);
+    QReadLocker locker(&d->devlock);
+    const QHash<int, qint64> stamps = d->devstamp.value(dev);
+    if (!stamps.contains(field)) {
+        return QDateTime();
+    }
+    return QDateTime::fromMSecsSinceEpoch(stamps.value(field));
+}
+
+/*!
+ * \brief Get how long the last getDeviceProperty() call spent
+ * querying the drive, in microseconds (0 if served from the cache).
+ */
+qint64 DISOMaster::devicePropertyLatency() const
+{
+    Q_D(const DISOMaster);
+    return d->propertylatency;
+}
+
+/*!
+ * \brief Get how long the constructor took to get a ready xorriso
+ * handle, in microseconds.
+ *
+ * A handle taken from the pool costs next to nothing, a new one has
+ * to start up libburn and libisofs first.
+ * \sa prewarmHandles()
+ */
+qint64 DISOMaster::constructionLatency() const
+{
+    Q_D(const DISOMaster);
+    return d->constructlatency;
+}
+
+/*!
+ * \brief Get how long the last successful acquireDevice() took, in
+ * microseconds, including leasing a handle if none was held.
+ */
+qint64 DISOMaster::acquireLatency() const
+{
+    Q_D(const DISOMaster);
+    return d->acquirelatency;
+}
+
+/*!
+ * \brief Start count xorriso handles ahead of time, so that the next
+ * DISOMaster instances do not pay for the library startup.
+ *
+ * Never starts more than the idle limit allows.
+ * \sa setIdleHandleLimit()
+ */
+void DISOMaster::prewarmHandles(int count)
+{
+    XorrisoPool::instance()->prewarm(count);
+}
+
+/*!
+ * \brief Keep at most count released xorriso handles around for reuse,
+ * 4 by default. 0 destroys every handle once it is released.
+ */
+void DISOMaster::setIdleHandleLimit(int count)
+{
+    XorrisoPool::instance()->setIdleLimit(count);
+}
+
+/*!
+ * \brief Get the number of xorriso handles waiting in the pool.
+ */
+int DISOMaster::idleHandles()
+{
+    return XorrisoPool::instance()->idleCount();
 }
 
 /*!
  * \brief Get cached property of a device.
  *
  * Returns the property of a device when it was acquired
- * last time. Does not require a device acquired.
+ * last time. Does not require a device acquired, and never
+ * blocks on the drive: it is safe to call from any thread.
  * If the device has no property cached, this function will return an
  * invalid device property, which you can tell by testing whether the
  * devid field is empty.
@@ -173,25 +517,24 @@ DeviceProperty DISOMaster::getDeviceProperty()
 DeviceProperty DISOMaster::getDevicePropertyCached(QString dev) const
 {
     Q_D(const DISOMaster);
-    if (d->dev.find(dev) != d->dev.end()) {
-        return d->dev[dev];
-    }
-    return DeviceProperty();
+    return d->deviceProperty(dev);
 }
 
 /*!
  * \brief Nullify cached device property for a drive.
  *
- * Call this after a disc swap (or whenever you are sure
- * the previously cached device property is no longer
- * up to date).
+ * Call this whenever you are sure the previously cached
+ * device property is no longer up to date. Jobs that write or
+ * blank the media nullify it for their drive when they end; disc
+ * swaps and drive removal reported by the kernel nullify the cache
+ * automatically, see deviceChanged().
  */
 void DISOMaster::nullifyDevicePropertyCache(QString dev)
 {
     Q_D(DISOMaster);
-    if (d->dev.find(dev) != d->dev.end()) {
-        d->dev.erase(d->dev.find(dev));
-    }
+    QWriteLocker locker(&d->devlock);
+    d->dev.remove(dev);
+    d->devstamp.remove(dev);
 }
 
 /*!
@@ -200,46 +543,226 @@ void DISOMaster::nullifyDevicePropertyCache(QString dev)
  * This will clear the internal message buffer.
  *
  * \return a list of messages from xorriso since the last command.
+ * \sa takeLogMessages()
  */
 QStringList DISOMaster::getInfoMessages()
 {
     Q_D(DISOMaster);
-    QStringList ret = d->xorrisomsg;
-    d->xorrisomsg.clear();
+    QStringList ret;
+    for (LogMessage &m : d->log.drain()) {
+        ret.push_back(std::move(m.text));
+    }
+    return ret;
+}
+
+/*!
+ * \brief Take the messages from xorriso logged since the last command.
+ *
+ * The log keeps the latest 4096 messages that pass the log filter,
+ * older ones are dropped.
+ */
+QList<LogMessage> DISOMaster::takeLogMessages()
+{
+    Q_D(DISOMaster);
+    return d->log.drain();
+}
+
+/*!
+ * \brief Number of messages dropped from the full log so far.
+ */
+quint64 DISOMaster::droppedLogMessages() const
+{
+    Q_D(const DISOMaster);
+    return d->log.dropped();
+}
+
+/*!
+ * \brief Only log messages of the given categories and at least the given severity.
+ */
+void DISOMaster::setLogFilter(LogMessage::Categories categories, LogMessage::Severity minseverity)
+{
+    Q_D(DISOMaster);
+    d->log.setFilter(categories, minseverity);
+}
+
+/*!
+ * \brief Echo logged messages to stderr, from a thread of its own.
+ * Off by default; the thread is only started once it is turned on.
+ */
+void DISOMaster::setLogToStderr(bool on)
+{
+    Q_D(DISOMaster);
+    d->log.setEcho(on);
+}
+
+/*!
+ * \brief Get the latest progress of the current (or last) job.
+ */
+JobProgress DISOMaster::progress() const
+{
+    Q_D(const DISOMaster);
+    QMutexLocker locker(&d->proglock);
+    return d->prog;
+}
+
+/*!
+ * \brief Set the minimum time between two progressChanged() signals.
+ * \param msecs interval in milliseconds, 250 by default. 0 emits every change.
+ */
+void DISOMaster::setProgressInterval(int msecs)
+{
+    Q_D(DISOMaster);
+    QMutexLocker locker(&d->proglock);
+    d->proginterval = qMax(msecs, 0);
+}
+
+/*!
+ * \brief Write settings tuned for a type of media, for setWriteSettings().
+ *
+ * Stream recording is on for BD and DVD-RAM, where the defect
+ * management of the drive otherwise halves the write speed. Only CD
+ * gets the usual 300 KiB padding against read-ahead bugs.
+ *
+ * They are not applied unless set: a job without write settings keeps
+ * the defaults of xorriso.
+ */
+WriteSettings WriteSettings::forMedia(MediaType media)
+{
+    WriteSettings ret;
+    ret.streamrecording = StreamOff;
+    switch (media) {
+    case MediaType::CD_ROM:
+    case MediaType::CD_R:
+    case MediaType::CD_RW:
+        ret.fifosize = 4 << 20;
+        ret.padding = 300 << 10;
+        break;
+    case MediaType::DVD_RAM:
+        ret.streamrecording = StreamOn;
+        ret.fifosize = 16 << 20;
+        ret.padding = 0;
+        ret.obs = 32 << 10;
+        break;
+    case MediaType::BD_ROM:
+    case MediaType::BD_R:
+    case MediaType::BD_RE:
+        ret.streamrecording = StreamOn;
+        ret.fifosize = 32 << 20;
+        ret.padding = 0;
+        ret.obs = 64 << 10;
+        break;
+    default:    //DVD, and stdio: pseudo-drives
+        ret.fifosize = 16 << 20;
+        ret.padding = 0;
+        ret.obs = 32 << 10;
+        break;
+    }
     return ret;
 }
 
+/*!
+ * \brief Set how commit() and writeISO() drive the writing.
+ *
+ * Fields left at their default value keep the defaults of xorriso:
+ * no stream recording, a 4 MiB FIFO, 300 KiB padding and the default
+ * transaction size. WriteSettings::forMedia() gives settings tuned for
+ * a type of media.
+ */
+void DISOMaster::setWriteSettings(const WriteSettings &settings)
+{
+    Q_D(DISOMaster);
+    d->writesettings = settings;
+}
+
+WriteSettings DISOMaster::writeSettings() const
+{
+    Q_D(const DISOMaster);
+    return d->writesettings;
+}
+
+/*!
+ * \brief Get the write speed WriteSpeed::Auto picks for the media in
+ * the drive, in kilobytes per second (0 for the fastest).
+ *
+ * The pick depends on the media type, its manufacturer and product id,
+ * the speeds the drive offers for it, and what the media profile
+ * database recorded about burns and media checks of the same media.
+ * Burns and checks update the database once they are done.
+ * \sa setMediaProfileDatabase()
+ */
+int DISOMaster::chooseWriteSpeed()
+{
+    Q_D(DISOMaster);
+    return d->chooseWriteSpeed();
+}
+
+/*!
+ * \brief Keep the media profile database in the file path, shared by
+ * all instances. An empty path keeps it in memory only.
+ *
+ * By default there is no file, and nothing is kept across processes.
+ * Processes sharing a file serialize their updates with a lock file.
+ */
+void DISOMaster::setMediaProfileDatabase(const QString &path)
+{
+    MediaProfiles::instance()->setPath(path);
+}
+
+QString DISOMaster::mediaProfileDatabase()
+{
+    return MediaProfiles::instance()->path();
+}
+
 /*!
  * \brief Get the current data transfer rate.
  *
  * The value is a multiplier of base speed of the current media.
  *
  * \return a string containing a multiplier (e.g. "10.0x").
+ *
+ * Safe to call from any thread while a job is running.
  */
 QString DISOMaster::getCurrentSpeed() const
 {
     Q_D(const DISOMaster);
-    return d->curspeed;
+    return d->watcher.speed();
 }
 
 /*!
  * \brief Stage files for burning.
  * \param filelist A map from local files to on-disc files.
+ *
+ * Staging a local file again replaces its on-disc file.
+ * A file that is already staged as part of a staged directory,
+ * at the very place the directory would put it, is burnt only once.
  */
 void DISOMaster::stageFiles(const QHash<QUrl, QUrl> filelist)
 {
     Q_D(DISOMaster);
-    d->files.unite(filelist);
+    QVector<StagingTree::Entry> entries;
+    entries.reserve(filelist.size());
+    for (auto it = filelist.cbegin(); it != filelist.cend(); ++it) {
+        entries.push_back(StagingTree::Entry(it.key().toString(), it.value().toString()));
+    }
+    d->files.insert(entries);
 }
 
 /*!
  * \brief Get all files currently staged for burning.
  * \return a map from local files to on-disc files.
+ *
+ * The map is built on each call.
  */
-const QHash<QUrl, QUrl> &DISOMaster::stagingFiles() const
+QHash<QUrl, QUrl> DISOMaster::stagingFiles() const
 {
     Q_D(const DISOMaster);
-    return d->files;
+    QHash<QUrl, QUrl> ret;
+    const QList<StagingTree::Entry> entries = d->files.entries();
+    ret.reserve(entries.size());
+    for (const StagingTree::Entry &e : entries) {
+        ret.insert(QUrl(e.first), QUrl(e.second));
+    }
+    return ret;
 }
 
 /*!
@@ -250,36 +773,131 @@ void DISOMaster::removeStagingFiles(const QList<QUrl> filelist)
 {
     Q_D(DISOMaster);
     for (auto &i : filelist) {
-        auto it = d->files.find(i);
-        if (it != d->files.end()) {
-            d->files.erase(it);
+        d->files.remove(i.toString());
+    }
+}
+
+/*!
+ * \brief Unstage a local directory and everything staged below it.
+ * \param dir the local directory to unstage.
+ * \return the number of staged files removed.
+ */
+int DISOMaster::removeStagingTree(const QUrl dir)
+{
+    Q_D(DISOMaster);
+    return d->files.removeTree(dir.toString());
+}
+
+/*!
+ * \brief Get the approximate heap memory held by the staged files, in bytes.
+ */
+quint64 DISOMaster::stagingMemoryUsage() const
+{
+    Q_D(const DISOMaster);
+    return d->files.memoryUsage();
+}
+
+/*!
+ * \brief Plan how to spread the staged files over several discs.
+ * \param capacity bytes per disc, 0 for the space available on the
+ * media in the drive
+ * \param opts whether to keep directories together, and to split
+ * files bigger than a disc
+ * \param burnopts the options the discs will be burnt with
+ * \param volId the volume name the discs will get
+ *
+ * Files are packed first-fit-decreasing on an estimate of their size
+ * on the disc. Then the image of each disc is built in memory with the
+ * same options, without writing it, and measured: files that do not
+ * fit move on to the next disc, and are removed from the image of the
+ * disc before it is measured again. The size of each disc is exact,
+ * including the file system and the manifest of the disc.
+ *
+ * Nothing is written and the staged files do not change. Stage a disc
+ * of the plan with stageDiscPlan(), then commit() it.
+ *
+ * \return the discs, or an empty list if nothing is staged, if a file
+ * is bigger than a disc and SplitLargeFiles is not set, or on error.
+ */
+QList<DiscPlan> DISOMaster::planSpanning(qint64 capacity, SpanOptions opts, const BurnOptions &burnopts, QString volId)
+{
+    Q_D(DISOMaster);
+    if (capacity <= 0) {
+        capacity = qint64(getDeviceProperty(CapacityField).avail);
+    }
+    const BurnOptions isoopts = burnopts & ~BurnOptions(Incremental | Deduplicate);
+    PlanMeasure m;
+    return SpanPlanner::plan(d->files.entries(true), capacity, opts, [d, &m, isoopts, volId](const DiscPlan &plan) {
+        return d->measurePlan(m, plan, isoopts, volId);
+    });
+}
+
+/*!
+ * \brief Stage a disc planned by planSpanning() in place of the files
+ * staged so far, along with its manifest as /.disomaster-span.
+ */
+void DISOMaster::stageDiscPlan(const DiscPlan &plan)
+{
+    Q_D(DISOMaster);
+    d->clearStaging();
+    QVector<StagingTree::Entry> whole;
+    for (const SpanFile &f : plan.files) {
+        if (f.parts) {
+            d->spanparts.push_back(f);
+        } else {
+            whole.push_back({ f.source, f.target });
         }
     }
+    d->manifestfile.reset(new QTemporaryFile);
+    if (d->manifestfile->open()) {
+        d->manifestfile->write(plan.manifest);
+        d->manifestfile->flush();
+        d->manifestfile->setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::ReadOther);
+        whole.push_back({ d->manifestfile->fileName(), SpanPlanner::ManifestPath });
+    }
+    d->files.insert(whole);
 }
 
 /*!
  * \brief DISOMaster::commit  Burn all staged files to the disc.
  * \param opts   burning options
- * \param speed  desired writing speed in kilobytes per second
+ * \param speed  desired writing speed in kilobytes per second, or
+ *               WriteSpeed::Auto (see chooseWriteSpeed())
  * \param volId  volume name of the disc
  * \return       true on success, false on failure
+ *
+ * With VerifyDatas, the job goes on with status Verifying once written,
+ * and fails if the session read back does not match its MD5. The files
+ * that do not match are listed in the job result.
+ *
+ * With Incremental, only staged files that differ from the loaded
+ * session are written; the job result counts written and skipped files.
+ * A file counts as unchanged if its inode number and timestamps match
+ * those recorded by an appendable (KeepAppendable) or incremental
+ * commit; with IncrementalMD5 its content is read and compared instead.
+ *
+ * With Deduplicate, staged files with identical content share one copy
+ * of the data on the disc; the job result counts the bytes saved.
+ *
+ * The job result holds the speed asked for, also when picked by
+ * WriteSpeed::Auto.
  */
 bool DISOMaster::commit(const BurnOptions &opts, int speed /* = 0*/, QString volId /* = "ISOIMAGE"*/)
 {
     Q_D(DISOMaster);
     Q_EMIT jobStatusChanged(JobStatus::Stalled, 0);
-    d->xorrisomsg.clear();
-
-    QString spd = QString::number(speed) + "k";
-    if (speed == 0) {
-        spd = "0";
-    }
+    d->log.discard();
+    d->beginJob(JobProgress::Writing);
+    const QString spd = d->speedArgument(speed);
 
     int r;
 
     XORRISO_OPT(speed, d->xorriso, spd.toUtf8().data(), 0);
     JOBFAILED_IF(r, d->xorriso);
 
+    r = d->applyWriteSettings(d->writesettings);
+    JOBFAILED_IF(r, d->xorriso);
+
     XORRISO_OPT(volid, d->xorriso, volId.toUtf8().data(), 0);
     JOBFAILED_IF(r, d->xorriso);
 
@@ -292,27 +910,59 @@ bool DISOMaster::commit(const BurnOptions &opts, int speed /* = 0*/, QString vol
     XORRISO_OPT(rockridge, d->xorriso, PCHAR(opts.testFlag(RockRidgeSupport) ? "on" : "off"), 0);
     JOBFAILED_IF(r, d->xorriso);
 
-    for (auto it = d->files.begin(); it != d->files.end(); ++it) {
-        XORRISO_OPT(
-                map, d->xorriso,
-                it.key().toString().toUtf8().data(),
-                it.value().toString().toUtf8().data(),
-                0);
-        JOBFAILED_IF(r, d->xorriso);
-    }
+    //session and file MD5s are recorded while writing, so verifying is one read pass
+    const bool verify = opts.testFlag(VerifyDatas);
+    const bool incremental = opts.testFlag(Incremental);
+    const bool md5 = verify || (incremental && opts.testFlag(IncrementalMD5));
+    XORRISO_OPT(md5, d->xorriso, PCHAR(md5 ? "on" : "off"), 0);
+    JOBFAILED_IF(r, d->xorriso);
+
+    //record inode numbers for the next -update, and trust them there unless content is asked for.
+    //ino_only: device numbers of USB and network disks are not stable
+    const bool byinode = (incremental || opts.testFlag(KeepAppendable)) && !(incremental && opts.testFlag(IncrementalMD5));
+    XORRISO_OPT(disk_dev_ino, d->xorriso, PCHAR(byinode ? "ino_only" : "off"), 0);
+    JOBFAILED_IF(r, d->xorriso);
+
+    d->verifying = verify;
+
+    r = d->mapStagingFiles(opts);
+    JOBFAILED_IF(r, d->xorriso);
 
     XORRISO_OPT(close, d->xorriso, PCHAR(opts.testFlag(KeepAppendable) ? "off" : "on"), 0);
     JOBFAILED_IF(r, d->xorriso);
 
+    JOBCANCELLED_IF_REQUESTED();
+    d->profilekey = d->profileKey();
     XORRISO_OPT(commit, d->xorriso, 0);
     JOBFAILED_IF(r, d->xorriso);
+    JOBCANCELLED_IF_REQUESTED();
+
+    //the new session starts after the lead-out/lead-in gap, not at the old end of data
+    qint64 sessionstart = 0;
+    if (verify || incremental) {
+        sessionstart = d->lastSessionStart();
+        r = sessionstart >= 0;
+        JOBFAILED_IF(r, d->xorriso);
+    }
+
+    if (incremental) {
+        r = d->countDelta(sessionstart);
+        JOBFAILED_IF(r, d->xorriso);
+    }
 
+    if (verify) {
+        r = d->verifySession(sessionstart);
+        JOBFAILED_IF(r, d->xorriso);
+        Q_EMIT jobStatusChanged(JobStatus::Finished, 0);
+    }
+
+    d->endJob(true);
     return true;
 }
 
 /*!
  * \brief Burn all staged files to the disc.
- * \param speed desired writing speed in kilobytes per second
+ * \param speed desired writing speed in kilobytes per second, or WriteSpeed::Auto
  * \param closeSession if true, closes the session after files are burned
  * \param volId volume name of the disc
  * \return true on success, false on failure
@@ -324,18 +974,18 @@ bool DISOMaster::commit(int speed, bool closeSession, QString volId)
 {
     Q_D(DISOMaster);
     Q_EMIT jobStatusChanged(JobStatus::Stalled, 0);
-    d->xorrisomsg.clear();
-
-    QString spd = QString::number(speed) + "k";
-    if (speed == 0) {
-        spd = "0";
-    }
+    d->log.discard();
+    d->beginJob(JobProgress::Writing);
+    const QString spd = d->speedArgument(speed);
 
     int r;
 
     XORRISO_OPT(speed, d->xorriso, spd.toUtf8().data(), 0);
     JOBFAILED_IF(r, d->xorriso);
 
+    r = d->applyWriteSettings(d->writesettings);
+    JOBFAILED_IF(r, d->xorriso);
+
     XORRISO_OPT(volid, d->xorriso, volId.toUtf8().data(), 0);
     JOBFAILED_IF(r, d->xorriso);
 
@@ -348,21 +998,17 @@ bool DISOMaster::commit(int speed, bool closeSession, QString volId)
     XORRISO_OPT(rockridge, d->xorriso, PCHAR("on"), 0);
     JOBFAILED_IF(r, d->xorriso);
 
-    for (auto it = d->files.begin(); it != d->files.end(); ++it) {
-        XORRISO_OPT(
-                map, d->xorriso,
-                it.key().toString().toUtf8().data(),
-                it.value().toString().toUtf8().data(),
-                0);
-        JOBFAILED_IF(r, d->xorriso);
-    }
+    r = d->mapStagingFiles(BurnOptions());
+    JOBFAILED_IF(r, d->xorriso);
 
     XORRISO_OPT(close, d->xorriso, PCHAR(closeSession ? "on" : "off"), 0);
     JOBFAILED_IF(r, d->xorriso);
 
+    d->profilekey = d->profileKey();
     XORRISO_OPT(commit, d->xorriso, 0);
     JOBFAILED_IF(r, d->xorriso);
 
+    d->endJob(true);
     return true;
 }
 
@@ -374,13 +1020,17 @@ bool DISOMaster::erase()
 {
     Q_D(DISOMaster);
     Q_EMIT jobStatusChanged(JobStatus::Running, 0);
-    d->xorrisomsg.clear();
+    d->log.discard();
+    d->beginJob(JobProgress::Blanking);
 
     int r;
     XORRISO_OPT(abort_on, d->xorriso, PCHAR("ABORT"), 0);
+    JOBCANCELLED_IF_REQUESTED();
     XORRISO_OPT(blank, d->xorriso, PCHAR("as_needed"), 0);
     JOBFAILED_IF(r, d->xorriso);
 
+    d->burnedspeed = -1;
+    d->endJob(true);
     return true;
 }
 
@@ -392,55 +1042,142 @@ bool DISOMaster::erase()
  * \return true on success, false on failure (if for some reason the disc could not be checked)
  *
  * The values returned should add up to 1 (or very close to 1).
+ * \sa checkmediaRange()
  */
 bool DISOMaster::checkmedia(double *qgood, double *qslow, double *qbad)
 {
     Q_D(DISOMaster);
-    Q_EMIT jobStatusChanged(JobStatus::Running, 0);
-    d->xorrisomsg.clear();
-
-    int r, ac, avail;
-    int dummy = 0;
-    char **av;
-
-    getDeviceProperty();
-    XORRISO_OPT(check_media, d->xorriso, 0, nullptr, &dummy, 0);
-    JOBFAILED_IF(r, d->xorriso);
+    const bool ret = checkmediaRange(0, -1, false);
+    if (qgood) {
+        *qgood = d->result.qgood;
+    }
+    if (qslow) {
+        *qslow = d->result.qslow;
+    }
+    if (qbad) {
+        *qbad = d->result.qbad;
+    }
+    return ret;
+}
+
+/*!
+ * \brief Check a range of blocks of the disc.
+ * \param startlba first block to check
+ * \param blocks number of blocks to check, or -1 to check up to the
+ *        end of the recorded data (the used area of the disc)
+ * \param stoponbad stop at the end of the step that found the first bad region
+ * \return true on success, false on failure (if for some reason the disc could not be checked)
+ *
+ * The range is scanned in steps. mediaRegionChecked() is emitted for
+ * every region found as soon as its step completes, and the job result
+ * holds the merged map of regions and the portions of good / slow / bad
+ * blocks among the blocks checked.
+ */
+bool DISOMaster::checkmediaRange(qint64 startlba, qint64 blocks, bool stoponbad)
+{
+    Q_D(DISOMaster);
+    Q_EMIT jobStatusChanged(JobStatus::Running, 0);
+    d->log.discard();
+    d->beginJob(JobProgress::Reading);
+
+    int r, ac, avail;
+    int dummy = 0;
+    char **av;
+
+    const qint64 datablocks = qint64(getDeviceProperty(CapacityField).datablocks);
+    const qint64 end = blocks < 0 ? datablocks : startlba + blocks;
+    d->pausable = true;
+    d->profilekey = d->profileKey();
+    const QByteArray abortarg = "abort_file=" + QFile::encodeName(d->abortfile);
+
+    //about 32 steps, but no tiny ones. Unknown size: a single run.
+    const qint64 step = end > startlba ? qMax<qint64>((end - startlba) / 32, 16384) : 0;
+    d->scantotal = end > startlba ? end - startlba : datablocks;
 
     quint64 ngood = 0;
     quint64 nslow = 0;
     quint64 nbad = 0;
+    bool stop = false;
+
+    //a step cut short by pause() goes on where it stopped
+    qint64 lba = startlba;
+    for (bool again = true; !stop && again && (!step || lba < end);) {
+        const qint64 stepend = step ? qMin(lba + step, end) : -1;
+        QVector<QByteArray> args { abortarg };
+        if (lba > 0) {
+            args.push_back("min_lba=" + QByteArray::number(lba));
+        }
+        if (stepend > 0) {
+            args.push_back("max_lba=" + QByteArray::number(stepend - 1));
+        }
+        QVector<char *> argv;
+        for (QByteArray &arg : args) {
+            argv.push_back(arg.data());
+        }
 
-    do {
-        Xorriso_sieve_get_result(d->xorriso, PCHAR("Media region :"), &ac, &av, &avail, 0);
-        if (ac == 3) {
-            quint64 szblk = QString(av[1]).toLongLong();
-            if (av[2][0] == '-') {
-                nbad += szblk;
-            } else if (av[2][0] == '0') {
-                ngood += szblk;
-            } else {
-                if (QString(av[2]).contains("slow")) {
-                    nslow += szblk;
-                } else {
-                    ngood += szblk;
+        d->scanbase = lba - startlba;
+        dummy = 0;
+        XORRISO_OPT(check_media, d->xorriso, argv.size(), argv.data(), &dummy, 0);
+        JOBFAILED_IF(r, d->xorriso);
+        JOBCANCELLED_IF_REQUESTED();
+
+        qint64 untested = -1;
+        do {
+            Xorriso_sieve_get_result(d->xorriso, PCHAR("Media region :"), &ac, &av, &avail, 0);
+            if (ac == 3) {
+                MediaRegion region;
+                region.start = QString(av[0]).toLongLong();
+                region.length = QString(av[1]).toLongLong();
+                region.quality = regionQualityFromString(av[2]);
+                if (region.quality == MediaRegion::Untested && d->pauserequested) {
+                    untested = untested < 0 ? region.start : qMin(untested, region.start);
+                    Xorriso__dispose_words(&ac, &av);
+                    continue;
+                }
+                //only what this step was asked to check
+                if (stepend > 0) {
+                    const qint64 s = qMax(region.start, lba);
+                    region.length = qMin(region.start + region.length, stepend) - s;
+                    region.start = s;
+                }
+                if (region.length > 0) {
+                    switch (region.quality) {
+                    case MediaRegion::Bad:
+                        nbad += region.length;
+                        stop = stop || stoponbad;
+                        break;
+                    case MediaRegion::Slow:
+                        nslow += region.length;
+                        break;
+                    default:
+                        ngood += region.length;
+                        break;
+                    }
+                    addMediaRegion(d->result.regions, region);
+                    Q_EMIT mediaRegionChecked(region);
                 }
             }
-        }
-        Xorriso__dispose_words(&ac, &av);
-    } while (avail > 0);
+            Xorriso__dispose_words(&ac, &av);
+        } while (avail > 0);
 
-    if (qgood) {
-        *qgood = 1. * ngood / d->dev[d->curdev].datablocks;
-    }
-    if (qslow) {
-        *qslow = 1. * nslow / d->dev[d->curdev].datablocks;
-    }
-    if (qbad) {
-        *qbad = 1. * nbad / d->dev[d->curdev].datablocks;
+        Xorriso_sieve_clear_results(d->xorriso, 0);
+
+        if (untested >= 0) {
+            lba = untested;
+        } else if (step) {
+            lba = stepend;
+        } else {
+            again = false;
+        }
+        d->waitWhilePaused();
+        JOBCANCELLED_IF_REQUESTED();
     }
 
-    Xorriso_sieve_clear_results(d->xorriso, 0);
+    const double total = qMax<quint64>(ngood + nslow + nbad, 1);
+    d->result.qgood = ngood / total;
+    d->result.qslow = nslow / total;
+    d->result.qbad = nbad / total;
+    d->endJob(true);
 
     Q_EMIT jobStatusChanged(DISOMaster::JobStatus::Finished, 0);
 
@@ -451,228 +1188,1469 @@ bool DISOMaster::checkmedia(double *qgood, double *qslow, double *qbad)
  * \brief Dump the content of the disc to a file
  *  xorriso -outdev /dev/sr[?] -check_media use=outdev data_to=[path]
  * \param isopath the image file to be dumped
+ * \param opts digests to compute while dumping, and whether to write holes
+ * \param chunksize if not 0, also compute the digests of every chunksize bytes
  * \return true on success, false on failure
+ *
+ * The digests are computed as the image streams to disk and returned
+ * in the job result, so verifying the dump takes no further read pass.
+ * The job fails if the image file cannot be opened or read back for them.
  */
-bool DISOMaster::dumpISO(const QUrl isopath)
+bool DISOMaster::dumpISO(const QUrl isopath, const DumpOptions &opts, qint64 chunksize)
 {
     Q_D(DISOMaster);
     Q_EMIT jobStatusChanged(JobStatus::Running, 0);
-    d->xorrisomsg.clear();
+    d->log.discard();
+    d->beginJob(JobProgress::Reading);
 
     Q_ASSERT(!isopath.isEmpty());
     Q_ASSERT(isopath.isValid());
 
     int r;
-    char **av = new char *[2];
     int dummy = 0;
-    av[0] = strdup((QString("use=outdev")).toUtf8().data());
-    av[1] = strdup((QString("data_to=") + isopath.path()).toUtf8().data());
-    XORRISO_OPT(check_media, d->xorriso, 2, av, &dummy, 0);
+    //the sector map lets a run cut short by pause() skip what was read already
+    const QString sectormap = d->abortfile + ".map";
+    ::unlink(QFile::encodeName(sectormap).constData());
+    QByteArray args[] = {
+        "use=outdev",
+        "data_to=" + QFile::encodeName(isopath.path()),
+        "abort_file=" + QFile::encodeName(d->abortfile),
+        "sector_map=" + QFile::encodeName(sectormap)
+    };
+    char *av[] = { args[0].data(), args[1].data(), args[2].data(), args[3].data() };
+    d->pausable = true;
+
+    //hash (and sparsify) the image as it is written, not in a second pass
+    QScopedPointer<DumpFollower> follower;
+    qint64 expectedsize = 0;
+    if (opts) {
+        expectedsize = qint64(getDeviceProperty(CapacityField).datablocks) * 2048;
+        follower.reset(new DumpFollower(isopath.path(), opts, chunksize));
+        //the digests asked for cannot be had without the image file
+        r = follower->start() ? 1 : 0;
+        if (r <= 0) {
+            Xorriso_msgs_submit(d->xorriso, 0, PCHAR("Cannot open the image file to hash it"), errno, PCHAR("FAILURE"), 0);
+        }
+        JOBFAILED_IF(r, d->xorriso);
+    }
 
-    for (int i = 0; i < 2; ++i)
-        free(av[i]);
-    delete[] av;
+    for (;;) {
+        XORRISO_OPT(check_media, d->xorriso, 4, av, &dummy, 0);
+        if (r <= 0 || !d->pauserequested) {
+            break;
+        }
+        d->waitWhilePaused();
+        if (d->cancelrequested) {
+            break;
+        }
+        dummy = 0;
+    }
+    ::unlink(QFile::encodeName(sectormap).constData());
+
+    //digests of a part of the image are no digests of the image
+    if (follower && !follower->finish(r > 0 && !d->cancelrequested, expectedsize)) {
+        r = 0;
+    }
+    JOBFAILED_IF(r, d->xorriso);
+    JOBCANCELLED_IF_REQUESTED();
+
+    if (follower) {
+        follower->fillResult(d->result);
+    }
+    d->endJob(true);
+    return true;
+}
+
+/*!
+ * \brief Write the staged files to an image file, without any drive.
+ * \param target the image file to create. An existing file is replaced.
+ * \param opts   burning options: file system extensions, Deduplicate,
+ *               and Preallocate to reserve the disk space first
+ * \param volId  volume name of the image
+ * \return       true on success, false on failure
+ *
+ * No drive may be held. The staged files stay staged, and the job
+ * result holds the throughput.
+ */
+bool DISOMaster::buildImage(const QUrl target, const BurnOptions &opts, QString volId)
+{
+    Q_D(DISOMaster);
+    Q_EMIT jobStatusChanged(JobStatus::Stalled, 0);
+    d->log.discard();
+    d->beginJob(JobProgress::Writing);
+
+    int r = d->curdev.isEmpty() ? 1 : 0;
+    JOBFAILED_IF(r, d->xorriso);
+
+    //a stdio: drive on an existing image would append a session to it
+    const QByteArray path = QFile::encodeName(target.path());
+    const int fd = ::open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    r = fd >= 0 ? 1 : 0;
+    JOBFAILED_IF(r, d->xorriso);
+
+    //output drive only: no image to load, no burn settings
+    XORRISO_OPT(dev, d->xorriso, ("stdio:" + target.path()).toUtf8().data(), 2);
+    if (r <= 0) {
+        ::close(fd);
+    }
+    JOBFAILED_IF(r, d->xorriso);
+
+    //a file does not need a sync every 16 MiB, and a large FIFO keeps the writes large
+    XORRISO_OPT(stdio_sync, d->xorriso, PCHAR("off"), 0);
+    if (r > 0) {
+        const qint64 fifo = d->writesettings.fifosize > 0 ? d->writesettings.fifosize : 64 << 20;
+        XORRISO_OPT(fs, d->xorriso, QByteArray::number(fifo).data(), 0);
+    }
+    if (r > 0) {
+        XORRISO_OPT(volid, d->xorriso, volId.toUtf8().data(), 0);
+    }
+    if (r > 0) {
+        XORRISO_OPT(joliet, d->xorriso, PCHAR(opts.testFlag(JolietSupport) ? "on" : "off"), 0);
+    }
+    if (r > 0) {
+        XORRISO_OPT(rockridge, d->xorriso, PCHAR(opts.testFlag(RockRidgeSupport) ? "on" : "off"), 0);
+    }
+    if (r > 0) {
+        XORRISO_OPT(md5, d->xorriso, PCHAR(opts.testFlag(VerifyDatas) ? "on" : "off"), 0);
+    }
+    if (r > 0) {
+        r = d->mapStagingFiles(opts & ~BurnOptions(Incremental));
+    }
+    if (r > 0 && opts.testFlag(Preallocate)) {
+        //reserve the blocks without changing the file size
+        int ac, avail;
+        char **av;
+        XORRISO_OPT(print_size, d->xorriso, 0);
+        Xorriso_sieve_get_result(d->xorriso, PCHAR("Image size   :"), &ac, &av, &avail, 1);
+        if (ac >= 1 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, QString(av[0]).remove('s').toLongLong() * 2048) != 0) {
+            //no room for the image is worth failing for, a file system without fallocate() is not
+            const int err = errno;
+            const bool full = err == ENOSPC || err == EFBIG;
+            Xorriso_msgs_submit(d->xorriso, 0, PCHAR("Cannot preallocate the image file"), err, PCHAR(full ? "FAILURE" : "WARNING"), 0);
+            if (full) {
+                r = 0;
+            }
+        }
+        Xorriso__dispose_words(&ac, &av);
+    }
+    ::close(fd);
+    JOBFAILED_IF(r, d->xorriso);
+
+    XORRISO_OPT(close, d->xorriso, PCHAR("on"), 0);
+    JOBFAILED_IF(r, d->xorriso);
 
+    XORRISO_OPT(commit, d->xorriso, 0);
     JOBFAILED_IF(r, d->xorriso);
 
+    //give up the stdio: drive, nothing is pending
+    Xorriso_option_end(d->xorriso, 1);
+    Xorriso_sieve_clear_results(d->xorriso, 0);
+
+    d->endJob(true);
+    d->result.throughput = 1000. * QFileInfo(target.path()).size() / qMax<qint64>(d->result.elapsed, 1);
     return true;
 }
 
 /*!
  * \brief Burn an image to the disc.
  * \param isopath the image file to be burnt.
- * \param speed the desired write speed in kilobytes per second.
+ * \param speed the desired write speed in kilobytes per second, or WriteSpeed::Auto.
+ * \param size size of the image in bytes. Required if isopath is not
+ *        a regular file (e.g. a pipe as "/dev/fd/N"), 0 otherwise.
  * \return true on success, false on failure
  */
-bool DISOMaster::writeISO(const QUrl isopath, int speed)
+bool DISOMaster::writeISO(const QUrl isopath, int speed, qint64 size)
 {
     Q_D(DISOMaster);
     Q_EMIT jobStatusChanged(JobStatus::Stalled, 0);
-    d->xorrisomsg.clear();
-    QString spd = QString::number(speed) + "k";
-    if (speed == 0) {
-        spd = "0";
-    }
+    d->log.discard();
+    d->beginJob(JobProgress::Writing);
+    const QString spd = d->speedArgument(speed);
 
     int r;
 
-    char **av = new char *[6];
+    char **av = new char *[11];
+    int ac = 0;
     int dummy = 0;
-    av[0] = strdup("cdrecord");
-    av[1] = strdup("-v");
-    av[2] = strdup((QString("dev=") + d->curdev).toUtf8().data());
-    av[3] = strdup("blank=as_needed");
-    av[4] = strdup((QString("speed=") + spd).toUtf8().data());
-    av[5] = strdup(isopath.path().toUtf8().data());
-    XORRISO_OPT(as, d->xorriso, 6, av, &dummy, 1);
+    av[ac++] = strdup("cdrecord");
+    av[ac++] = strdup("-v");
+    av[ac++] = strdup((QString("dev=") + d->curdev).toUtf8().data());
+    av[ac++] = strdup("blank=as_needed");
+    av[ac++] = strdup((QString("speed=") + spd).toUtf8().data());
+    //only what was set, cdrecord has its own defaults
+    const WriteSettings &ws = d->writesettings;
+    if (ws.fifosize > 0) {
+        av[ac++] = strdup((QString("fs=") + QString::number(ws.fifosize)).toUtf8().data());
+    }
+    if (ws.padding >= 0) {
+        av[ac++] = strdup((QString("padsize=") + QString::number(ws.padding)).toUtf8().data());
+    }
+    if (ws.streamrecording != WriteSettings::StreamDefault) {
+        av[ac++] = strdup(ws.streamrecording == WriteSettings::StreamOn ? "stream_recording=on" : "stream_recording=off");
+    }
+    if (ws.obs > 0) {
+        av[ac++] = strdup((QString("dvd_obs=") + QString::number(ws.obs)).toUtf8().data());
+    }
+    if (size > 0) {
+        av[ac++] = strdup((QString("tsize=") + QString::number(size)).toUtf8().data());
+    }
+    av[ac++] = strdup(isopath.path().toUtf8().data());
+    d->profilekey = d->profileKey();
+    r = d->cancelrequested || d->trackcut ? 0 : 1;
+    if (r > 0) {
+        XORRISO_OPT(as, d->xorriso, ac, av, &dummy, 1);
+    }
+    //libburn pads a short track up to tsize, that is no image of ours
+    if (d->trackcut) {
+        r = 0;
+    }
+
+    for (int i = 0; i < ac; ++i) {
+        free(av[i]);
+    }
+    delete[] av;
+
     JOBFAILED_IF(r, d->xorriso);
+    JOBCANCELLED_IF_REQUESTED();
 
     //-as cdrecord releases the device automatically.
     //we don't want that.
     acquireDevice(d->curdev);
 
-    for (int i = 0; i < 6; ++i) {
-        free(av[i]);
-    }
-    delete[] av;
-
+    d->endJob(true);
     return true;
 }
 
-void DISOMasterPrivate::getCurrentDeviceProperty()
+/*!
+ * \brief Burn an image read from a pipe or other file descriptor.
+ * \param fd the descriptor to read the image from. It stays open.
+ * \param size size of the image in bytes.
+ * \param speed the desired write speed in kilobytes per second, or WriteSpeed::Auto.
+ * \return true on success, false on failure
+ */
+bool DISOMaster::writeISO(int fd, qint64 size, int speed)
+{
+    return writeISO(QUrl::fromLocalFile(QString("/dev/fd/%1").arg(fd)), speed, size);
+}
+
+/*!
+ * \brief Burn an image read from a device, without an intermediate file.
+ * \param source the device to read the image from, open for reading.
+ * \param size size of the image in bytes. Exactly this much is read.
+ * \param speed the desired write speed in kilobytes per second, or WriteSpeed::Auto.
+ * \return true on success, false on failure
+ *
+ * The data goes straight into the libburn FIFO, see bufferFillChanged().
+ * The burn runs on the job thread while the calling thread, which must
+ * be the thread of source, reads from source. So this must not be called
+ * from within an asynchronous job.
+ *
+ * Nothing is burnt if source ends or fails before its first byte. If it
+ * does so later, the job fails; the drive may by then have written the
+ * track, padded up to size.
+ */
+bool DISOMaster::writeISO(QIODevice *source, qint64 size, int speed)
 {
-    if (!curdev.length()) {
-        return;
+    Q_D(DISOMaster);
+    if (!source || !source->isReadable() || size <= 0) {
+        return false;
     }
 
-    dev[curdev].devid = curdev;
-
-    int r, ac, avail;
-    char **av;
-    Xorriso_sieve_get_result(xorriso, PCHAR("Media current:"), &ac, &av, &avail, 0);
-    if (ac < 1) {
-        Xorriso__dispose_words(&ac, &av);
-        return;
+    TrackPipe pipe;
+    if (!pipe.isValid()) {
+        return false;
     }
-    QString mt = av[0];
-    const static QHash<QString, MediaType> typemap = {
-        { "CD-ROM", MediaType::CD_ROM },
-        { "CD-R", MediaType::CD_R },
-        { "CD-RW", MediaType::CD_RW },
-        { "DVD-ROM", MediaType::DVD_ROM },
-        { "DVD-R", MediaType::DVD_R },
-        { "DVD-RW", MediaType::DVD_RW },
-        { "DVD+R", MediaType::DVD_PLUS_R },
-        { "DVD+R/DL", MediaType::DVD_PLUS_R_DL },
-        { "DVD-RAM", MediaType::DVD_RAM },
-        { "DVD+RW", MediaType::DVD_PLUS_RW },
-        { "BD-ROM", MediaType::BD_ROM },
-        { "BD-R", MediaType::BD_R },
-        { "BD-RE", MediaType::BD_RE }
-    };
-    mt = mt.left(mt.indexOf(' '));
-    if (typemap.find(mt) != typemap.end()) {
-        dev[curdev].media = typemap[mt];
-    } else {
-        dev[curdev].media = MediaType::NoMedia;
+    QFuture<JobResult> job;
+    bool started = false;
+
+    bool eof = false;
+    QMetaObject::Connection c = connect(source, &QIODevice::readChannelFinished, [&eof] { eof = true; });
+
+    QByteArray buf(1 << 20, Qt::Uninitialized);
+    QElapsedTimer idle;
+    idle.start();
+    qint64 fed = 0;
+    //the burn starts with the first data, a source that fails before burns nothing.
+    //cancel() cuts the track short, the job then ends cancelled
+    while (fed < size && !(started && (job.isFinished() || d->cancelrequested))) {
+        const qint64 n = source->read(buf.data(), qMin<qint64>(buf.size(), size - fed));
+        if (n < 0) {
+            break;
+        }
+        if (n > 0) {
+            if (!started) {
+                d->trackcut = false;
+                job = writeISOAsync(pipe.track(), speed, size);
+                started = true;
+            }
+            if (!pipe.write(buf.constData(), n, job)) {
+                break;
+            }
+            fed += n;
+            idle.restart();
+            continue;
+        }
+        if (!source->isSequential() || eof || !source->isOpen() || idle.hasExpired(60000)) {
+            break;
+        }
+        //devices without waitForReadyRead() (e.g. network replies) need the event loop
+        if (!source->waitForReadyRead(100)) {
+            QEventLoop loop;
+            QTimer::singleShot(100, &loop, &QEventLoop::quit);
+            connect(source, &QIODevice::readyRead, &loop, &QEventLoop::quit);
+            loop.exec();
+        }
     }
-    Xorriso__dispose_words(&ac, &av);
+    disconnect(c);
 
-    Xorriso_sieve_get_result(xorriso, PCHAR("Media summary:"), &ac, &av, &avail, 0);
-    if (ac == 4) {
-        const QString units = "kmg";
-        dev[curdev].datablocks = atoll(av[1]);
-        dev[curdev].data = atof(av[2]) * (1 << ((units.indexOf(*(QString(av[2]).rbegin())) + 1) * 10));
-        dev[curdev].avail = atof(av[3]) * (1 << ((units.indexOf(*(QString(av[3]).rbegin())) + 1) * 10));
+    if (!started) {
+        d->result = JobResult();
+        return false;
     }
-    Xorriso__dispose_words(&ac, &av);
+    //fail the job rather than let a short track pass as the image
+    d->trackcut = fed < size;
+    pipe.closeWrite();
+    job.waitForFinished();
+    d->trackcut = false;
+    return fed == size && job.result().success;
+}
 
-    Xorriso_sieve_get_result(xorriso, PCHAR("Media status :"), &ac, &av, &avail, 0);
-    if (ac == 1) {
-        dev[curdev].formatted = QString(av[0]).contains("is blank");
-    }
-    Xorriso__dispose_words(&ac, &av);
+/*!
+ * \brief List the optical drives in the system.
+ * \param refresh look for new drives and probe again drives
+ * whose media changed since the last call.
+ *
+ * Does not require a device acquired. The first call probes all
+ * drives in parallel and may take as long as the slowest drive
+ * takes to spin up; later calls are served from a process-wide
+ * cache unless refresh is set. Drives held by someone else
+ * (including other DISOMaster instances) are listed as unavailable.
+ *
+ * \return the drives, sorted by device identifier.
+ */
+QList<DeviceInfo> DISOMaster::listDevices(bool refresh)
+{
+    return DeviceScanner::instance()->devices(refresh);
+}
 
-    Xorriso_sieve_get_result(xorriso, PCHAR("Volume id    :"), &ac, &av, &avail, 0);
-    if (ac == 1) {
-        dev[curdev].volid = QString(av[0]);
+/*!
+ * \brief Stop the running job.
+ *
+ * May be called from any thread. The job returns false as soon as
+ * xorriso gives control back, with the drive held again; the job
+ * result is marked cancelled and holds how long that took.
+ *
+ * checkmedia and dumpISO stop within about a second. A burn stops
+ * before it starts writing, or, when the image comes from a pipe or
+ * QIODevice, once the track is cut short. A burn from a file cannot
+ * be stopped once the drive writes. Queued jobs are not affected.
+ */
+void DISOMaster::cancel()
+{
+    Q_D(DISOMaster);
+    if (!d->jobrunning) {
+        return;
     }
-    Xorriso__dispose_words(&ac, &av);
+    d->cancelstamp = steadyMSecs();
+    d->cancelrequested = true;
+    d->touchAbortFile();
+    QMutexLocker locker(&d->pauselock);
+    d->resumed.wakeAll();
+}
 
-    XORRISO_OPT(list_speeds, xorriso, 0);
-    if (r <= 0) {
-        return;
+/*!
+ * \brief Pause the running checkmedia or dumpISO.
+ * \return false if no such job is running.
+ *
+ * May be called from any thread. The drive stops reading within about
+ * a second and the job waits, still holding the drive, until resume()
+ * or cancel(). Nothing is read twice after resuming.
+ */
+bool DISOMaster::pause()
+{
+    Q_D(DISOMaster);
+    if (!d->pausable) {
+        return false;
     }
+    d->pauserequested = true;
+    d->touchAbortFile();
+    return true;
+}
 
-    dev[curdev].writespeed.clear();
-    do {
-        Xorriso_sieve_get_result(xorriso, PCHAR("Write speed  :"), &ac, &av, &avail, 0);
-        if (ac == 2) {
-            dev[curdev].writespeed.push_back(QString(av[0]) + '\t' + QString(av[1]));
-        }
-        Xorriso__dispose_words(&ac, &av);
-    } while (avail > 0);
+/*!
+ * \brief Resume a job paused by pause().
+ */
+void DISOMaster::resume()
+{
+    Q_D(DISOMaster);
+    QMutexLocker locker(&d->pauselock);
+    d->pauserequested = false;
+    d->resumed.wakeAll();
+}
 
-    Xorriso_sieve_clear_results(xorriso, 0);
+bool DISOMaster::isPaused() const
+{
+    Q_D(const DISOMaster);
+    return d->pausable && d->pauserequested;
 }
 
-void DISOMasterPrivate::messageReceived(int type, char *text)
+/*!
+ * \brief Get the result of the last job.
+ *
+ * Only meaningful after the job has returned.
+ */
+JobResult DISOMaster::lastJobResult() const
 {
-    Q_Q(DISOMaster);
-    Q_UNUSED(type);
-    QString msg(text);
-    msg = msg.trimmed();
+    Q_D(const DISOMaster);
+    return d->result;
+}
 
-    fprintf(stderr, "msg from xorriso (%s) : %s\n", type ? " info " : "result", msg.toStdString().c_str());
-    xorrisomsg.push_back(msg);
+/*!
+ * \brief Asynchronous version of commit(const BurnOptions &, int, QString).
+ * \return a future holding the job result. Its progress value
+ * follows the job progress in percentage.
+ */
+QFuture<JobResult> DISOMaster::commitAsync(const BurnOptions &opts, int speed, QString volId)
+{
+    Q_D(DISOMaster);
+    return d->runJob([=] { commit(opts, speed, volId); });
+}
 
-    //closing session
-    if (msg.contains("UPDATE : Closing track/session.")) {
-        Q_EMIT q->jobStatusChanged(DISOMaster::JobStatus::Stalled, 1);
-        return;
-    }
+/*!
+ * \brief Asynchronous version of erase().
+ */
+QFuture<JobResult> DISOMaster::eraseAsync()
+{
+    Q_D(DISOMaster);
+    return d->runJob([=] { erase(); });
+}
 
-    //stalled
-    if (msg.contains("UPDATE : Thank you for being patient.")) {
-        Q_EMIT q->jobStatusChanged(DISOMaster::JobStatus::Stalled, 0);
-        return;
-    }
+/*!
+ * \brief Asynchronous version of checkmedia().
+ *
+ * The portions of good, slow and bad sectors are returned
+ * in the job result.
+ */
+QFuture<JobResult> DISOMaster::checkmediaAsync()
+{
+    Q_D(DISOMaster);
+    return d->runJob([=] { checkmedia(nullptr, nullptr, nullptr); });
+}
 
-    //cdrecord / blanking
-    QRegularExpression r("([0-9.]*)%\\s*(fifo|done)");
-    QRegularExpressionMatch m = r.match(msg);
-    if (m.hasMatch()) {
-        double percentage = m.captured(1).toDouble();
-        Q_EMIT q->jobStatusChanged(DISOMaster::JobStatus::Running, percentage);
-    }
+/*!
+ * \brief Asynchronous version of checkmediaRange().
+ */
+QFuture<JobResult> DISOMaster::checkmediaRangeAsync(qint64 startlba, qint64 blocks, bool stoponbad)
+{
+    Q_D(DISOMaster);
+    return d->runJob([=] { checkmediaRange(startlba, blocks, stoponbad); });
+}
+
+/*!
+ * \brief Asynchronous version of buildImage().
+ */
+QFuture<JobResult> DISOMaster::buildImageAsync(const QUrl target, const BurnOptions &opts, QString volId)
+{
+    Q_D(DISOMaster);
+    return d->runJob([=] { buildImage(target, opts, volId); });
+}
+
+/*!
+ * \brief Asynchronous version of dumpISO().
+ */
+QFuture<JobResult> DISOMaster::dumpISOAsync(const QUrl isopath, const DumpOptions &opts, qint64 chunksize)
+{
+    Q_D(DISOMaster);
+    return d->runJob([=] { dumpISO(isopath, opts, chunksize); });
+}
+
+/*!
+ * \brief Asynchronous version of writeISO().
+ */
+QFuture<JobResult> DISOMaster::writeISOAsync(const QUrl isopath, int speed, qint64 size)
+{
+    Q_D(DISOMaster);
+    return d->runJob([=] { writeISO(isopath, speed, size); });
+}
+
+/*!
+ * \brief Asynchronous version of writeISO() from a file descriptor.
+ */
+QFuture<JobResult> DISOMaster::writeISOAsync(int fd, qint64 size, int speed)
+{
+    Q_D(DISOMaster);
+    return d->runJob([=] { writeISO(fd, size, speed); });
+}
 
-    //commit
-    r = QRegularExpression("([0-9]*)\\s*of\\s*([0-9]*) MB written");
-    m = r.match(msg);
-    if (m.hasMatch()) {
-        double percentage = 100. * m.captured(1).toDouble() / m.captured(2).toDouble();
-        Q_EMIT q->jobStatusChanged(DISOMaster::JobStatus::Running, percentage);
+void DISOMasterPrivate::beginJob(JobProgress::Phase phase)
+{
+    lease();
+    result = JobResult();
+    profilekey.clear();
+    watcher.reset();
+    cancelrequested = false;
+    pauserequested = false;
+    clearAbortFile();
+    jobrunning = true;
+    mediajob = phase == JobProgress::Writing || phase == JobProgress::Blanking;
+    jobtimer.start();
+    {
+        QMutexLocker locker(&proglock);
+        prog = JobProgress();
+        progemitted = JobProgress();
+        prog.phase = phase;
+        laststatus = -2;
+        lastprogress = -1;
     }
+    publishProgress(true);
+}
 
-    //check media
-    r = QRegularExpression("([0-9]*) blocks read in ([0-9]*) seconds , ([0-9.]*)x");
-    m = r.match(msg);
-    if (m.hasMatch() && dev[curdev].datablocks != 0) {
-        double percentage = 100. * m.captured(1).toDouble() / dev[curdev].datablocks;
-        Q_EMIT q->jobStatusChanged(DISOMaster::JobStatus::Running, percentage);
+void DISOMasterPrivate::endJob(bool success)
+{
+    jobrunning = false;
+    pausable = false;
+    scantotal = 0;
+    verifying = false;
+
+    //wait (up to a second) for the watcher to pick up what is still
+    //pending on both channels, then collect what it handed over
+    Xorriso_peek_outlists(xorriso, -1, 1, 1 | 2 | 4);
+    result.minfifo = watcher.minFifo();
+    QString path;
+    while (watcher.takeMismatch(path)) {
+        result.mismatches.push_back(path);
     }
 
-    //current speed
-    r = QRegularExpression("([0-9]*\\.[0-9]x)[bBcCdD.]");
-    m = r.match(msg);
-    if (m.hasMatch()) {
-        curspeed = m.captured(1);
-    } else {
-        curspeed.clear();
+    result.success = success;
+    result.elapsed = jobtimer.elapsed();
+    if (!profilekey.isEmpty() && !cancelrequested) {
+        recordProfile(success);
     }
+    //a cancel is for this job only
+    cancelrequested = false;
+    if (mediajob) {
+        QWriteLocker locker(&devlock);
+        dev.remove(curdev);
+        devstamp.remove(curdev);
+    }
+    {
+        QMutexLocker locker(&proglock);
+        if (success) {
+            prog.percent = 100;
+            prog.bytesdone = prog.bytestotal;
+        }
+        prog.eta = 0;
+    }
+    publishProgress(true);
+}
 
-    //operation complete
-    if (msg.contains("Blanking done") || msg.contains(QRegularExpression("Writing to .* completed successfully."))) {
-        Q_EMIT q->jobStatusChanged(DISOMaster::JobStatus::Finished, 0);
+// -check_media stops once this file exists and is newer than the start of the run
+void DISOMasterPrivate::touchAbortFile()
+{
+    const QByteArray path = QFile::encodeName(abortfile);
+    ::unlink(path.constData());
+    const int fd = ::open(path.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        ::close(fd);
     }
 }
 
+void DISOMasterPrivate::clearAbortFile()
+{
+    ::unlink(QFile::encodeName(abortfile).constData());
 }
 
-int XorrisoResultHandler(void *handle, char *text)
+// between two runs of a pausable job: wait for resume() or cancel() if paused
+void DISOMasterPrivate::waitWhilePaused()
 {
-    ((DISOMasterNS::DISOMasterPrivate *)handle)->messageReceived(0, text);
-    return 1;
+    Q_Q(DISOMaster);
+    if (pauserequested && !cancelrequested) {
+        Q_EMIT q->jobStatusChanged(DISOMaster::JobStatus::Paused, 0);
+        {
+            QMutexLocker locker(&pauselock);
+            while (pauserequested && !cancelrequested) {
+                resumed.wait(&pauselock);
+            }
+        }
+        if (!cancelrequested) {
+            Q_EMIT q->jobStatusChanged(DISOMaster::JobStatus::Running, 0);
+        }
+    }
+    clearAbortFile();
 }
-int XorrisoInfoHandler(void *handle, char *text)
+
+/*
+ * End a cancelled job: drop whatever xorriso was doing and hold the
+ * drive again, so that the next job can start right away.
+ */
+void DISOMasterPrivate::teardown()
 {
-    //working around xorriso passing wrong handle to the callback
-    if (strstr(text, "DEBUG : Concurrent message watcher")) {
-        return 1;
+    int r;
+    Xorriso_option_end(xorriso, 1);
+    if (!curdev.isEmpty()) {
+        XORRISO_OPT(dev, xorriso, curdev.toUtf8().data(), 3);
+        if (r <= 0) {
+            setCurrentDevice("");
+        }
     }
-    ((DISOMasterNS::DISOMasterPrivate *)handle)->messageReceived(1, text);
-    return 1;
+    clearAbortFile();
+    endJob(false);
+    result.cancelled = true;
+    result.teardowntime = steadyMSecs() - cancelstamp;
 }
+
+// jobStatusChanged for a message, unless it says the same as the last one
+void DISOMasterPrivate::reportStatus(DISOMaster::JobStatus status, int progress)
+{
+    Q_Q(DISOMaster);
+    {
+        QMutexLocker locker(&proglock);
+        if (status == laststatus && progress == lastprogress) {
+            return;
+        }
+        laststatus = status;
+        lastprogress = progress;
+    }
+    Q_EMIT q->jobStatusChanged(status, progress);
+}
+
+/*
+ * Emit progressChanged if the progress changed and the last one is at
+ * least one interval old, or if forced. A dropped update is not lost:
+ * progress() returns it, and the next emitted one supersedes it.
+ */
+void DISOMasterPrivate::publishProgress(bool force)
+{
+    Q_Q(DISOMaster);
+    JobProgress p;
+    bool fill;
+    {
+        QMutexLocker locker(&proglock);
+        prog.elapsed = jobtimer.isValid() ? jobtimer.elapsed() : 0;
+        if (prog.percent > 0 && prog.percent < 100) {
+            prog.eta = qint64(prog.elapsed * (100 - prog.percent) / prog.percent);
+        }
+        if (!force) {
+            const bool same = prog.phase == progemitted.phase
+                    && qFuzzyCompare(1 + prog.percent, 1 + progemitted.percent)
+                    && prog.bytesdone == progemitted.bytesdone
+                    && prog.fifo == progemitted.fifo
+                    && prog.buffer == progemitted.buffer
+                    && qFuzzyCompare(1 + prog.speed, 1 + progemitted.speed);
+            if (same || (progtimer.isValid() && !progtimer.hasExpired(proginterval))) {
+                return;
+            }
+        }
+        fill = prog.fifo >= 0 && (prog.fifo != progemitted.fifo || prog.buffer != progemitted.buffer);
+        progemitted = prog;
+        progtimer.start();
+        p = prog;
+    }
+    Q_EMIT q->progressChanged(p);
+    if (fill) {
+        Q_EMIT q->bufferFillChanged(p.fifo, p.buffer);
+    }
+}
+
+QFuture<JobResult> DISOMasterPrivate::runJob(std::function<void()> job)
+{
+    Q_Q(DISOMaster);
+    QFutureInterface<JobResult> fi;
+    fi.setProgressRange(0, 100);
+    fi.reportStarted();
+
+    jobpool.start(new JobRunnable([this, q, fi, job]() mutable {
+        //the signal comes from the job or the watcher thread,
+        //QFutureInterface does its own locking.
+        QMetaObject::Connection c = QObject::connect(q, &DISOMaster::jobStatusChanged, q,
+                [fi](DISOMaster::JobStatus status, int progress) mutable {
+                    if (status == DISOMaster::JobStatus::Running) {
+                        fi.setProgressValue(progress);
+                    }
+                }, Qt::DirectConnection);
+        job();
+        QObject::disconnect(c);
+        fi.reportResult(result);
+        fi.reportFinished();
+    }));
+
+    return fi.future();
+}
+
+// -pathspecs as_mkisofs takes the character after a '\' literally
+static QByteArray escapePathspec(const QByteArray &path)
+{
+    QByteArray ret = path;
+    ret.replace('\\', "\\\\");
+    ret.replace('=', "\\=");
+    return ret;
+}
+
+// a single -add run with "iso_path=disk_path" pathspecs
+static int addPathspecs(XorrisO *xorriso, const QList<StagingTree::Entry> &entries)
+{
+    QVector<QByteArray> specs;
+    QVector<char *> av;
+    specs.reserve(entries.size());
+    av.reserve(entries.size());
+    for (const StagingTree::Entry &e : entries) {
+        specs.push_back(escapePathspec(e.second.toUtf8()) + '=' + escapePathspec(e.first.toUtf8()));
+    }
+    for (QByteArray &spec : specs) {
+        av.push_back(spec.data());
+    }
+
+    //bit0: do not report every single added file
+    int r;
+    int idx = 0;
+    XORRISO_OPT(add, xorriso, av.size(), av.data(), &idx, 1);
+    return r;
+}
+
+// the parts of split files, each cut out of its local file
+static int addParts(XorrisO *xorriso, const QList<SpanFile> &parts)
+{
+    int r = 1;
+    for (const SpanFile &f : parts) {
+        QByteArray source = f.source.toUtf8();
+        QByteArray offset = QByteArray::number(f.offset);
+        QByteArray length = QByteArray::number(f.length);
+        QByteArray target = f.target.toUtf8();
+        XORRISO_OPT(cut_out, xorriso, source.data(), offset.data(), length.data(), target.data(), 0);
+        if (r <= 0) {
+            break;
+        }
+    }
+    return r;
+}
+
+void DISOMasterPrivate::clearStaging()
+{
+    files.clear();
+    spanparts.clear();
+    manifestfile.reset();
+}
+
+/*
+ * Insert all staged files into the ISO tree with a single -add run
+ * using "iso_path=disk_path" pathspecs, instead of one -map (and one
+ * problem status evaluation) per file, then the parts of a disc plan.
+ * Incremental: compare each entry with the loaded session instead
+ * (size, mtime, recorded MD5 with -md5 on) and map only what changed.
+ * Deduplicate: then replace the copies of identical files by clones.
+ */
+int DISOMasterPrivate::mapStagingFiles(const BurnOptions &opts)
+{
+    QElapsedTimer t;
+    t.start();
+
+    int r;
+    XORRISO_OPT(pathspecs, xorriso, PCHAR("as_mkisofs"), 0);
+    if (r <= 0 || files.isEmpty()) {
+        return r;
+    }
+
+    const QList<StagingTree::Entry> entries = files.entries(true);
+    if (opts.testFlag(Incremental)) {
+        //like -update_r: what did not change stays in the loaded session
+        for (const StagingTree::Entry &e : entries) {
+            QByteArray source = e.first.toUtf8();
+            QByteArray target = e.second.toUtf8();
+            //bit3: recursive
+            XORRISO_OPT(update, xorriso, source.data(), target.data(), 8);
+            if (r <= 0) {
+                break;
+            }
+        }
+        result.treebuildtime = t.elapsed();
+        return r;
+    }
+
+    r = addPathspecs(xorriso, entries);
+    if (r > 0) {
+        r = addParts(xorriso, spanparts);
+    }
+    if (r > 0 && opts.testFlag(Deduplicate)) {
+        r = shareDuplicates();
+    }
+
+    result.treebuildtime = t.elapsed();
+    return r;
+}
+
+// the targets of plan and all directories above them
+static QSet<QString> planPaths(const DiscPlan &plan)
+{
+    QSet<QString> ret;
+    ret.reserve(plan.files.size());
+    for (const SpanFile &f : plan.files) {
+        QString p = f.target;
+        while (!p.isEmpty() && !ret.contains(p)) {
+            ret.insert(p);
+            p.truncate(p.lastIndexOf('/'));
+        }
+    }
+    return ret;
+}
+
+/*
+ * The size of the image of a disc plan in blocks, as -print_size
+ * computes it for an image on stdio:/dev/null with the same options.
+ * A handle of its own keeps the drive and staged files of this one.
+ * The tree is kept in m: measuring the same disc again removes what
+ * left it and adds what is new, and only a new disc is built anew.
+ */
+qint64 DISOMasterPrivate::measurePlan(PlanMeasure &m, const DiscPlan &plan, const BurnOptions &opts, const QString &volid)
+{
+    int r = 1;
+    if (m.h && m.disc != plan.disc) {
+        m.drop();
+    }
+    if (!m.h) {
+        m.h = XorrisoPool::instance()->lease(nullptr, nullptr);
+        if (!m.h || (!m.manifest.isOpen() && !m.manifest.open())) {
+            m.drop();
+            return -1;
+        }
+        m.disc = plan.disc;
+        XorrisO *x = m.h->xorriso;
+        XORRISO_OPT(outdev, x, PCHAR("stdio:/dev/null"), 0);
+        if (r > 0) {
+            XORRISO_OPT(volid, x, volid.toUtf8().data(), 0);
+        }
+        if (r > 0) {
+            XORRISO_OPT(joliet, x, PCHAR(opts.testFlag(JolietSupport) ? "on" : "off"), 0);
+        }
+        if (r > 0) {
+            XORRISO_OPT(rockridge, x, PCHAR(opts.testFlag(RockRidgeSupport) ? "on" : "off"), 0);
+        }
+        if (r > 0) {
+            XORRISO_OPT(md5, x, PCHAR(opts.testFlag(VerifyDatas) ? "on" : "off"), 0);
+        }
+        if (r > 0) {
+            XORRISO_OPT(pathspecs, x, PCHAR("as_mkisofs"), 0);
+        }
+        //the paths to remove are literal, not patterns
+        if (r > 0) {
+            XORRISO_OPT(iso_rr_pattern, x, PCHAR("off"), 0);
+        }
+    }
+    XorrisO *x = m.h->xorriso;
+
+    const QSet<QString> now = planPaths(plan);
+    //the topmost of what left the disc, and the previous manifest
+    std::vector<QByteArray> gone;
+    for (const QString &p : qAsConst(m.paths)) {
+        if (!now.contains(p) && !now.contains(p.left(p.lastIndexOf('/')))) {
+            gone.push_back(p.toUtf8());
+        }
+    }
+    if (!m.paths.isEmpty()) {
+        gone.push_back(SpanPlanner::ManifestPath);
+    }
+    if (r > 0 && !gone.empty()) {
+        std::vector<char *> av;
+        av.reserve(gone.size());
+        for (QByteArray &p : gone) {
+            av.push_back(p.data());
+        }
+        int idx = 0;
+        //bit0: recursive, like -rm_r
+        XORRISO_OPT(rmi, x, int(av.size()), av.data(), &idx, 1);
+    }
+
+    QList<StagingTree::Entry> whole;
+    QList<SpanFile> parts;
+    for (const SpanFile &f : plan.files) {
+        if (m.paths.contains(f.target)) {
+            continue;
+        }
+        if (f.parts) {
+            parts.push_back(f);
+        } else {
+            whole.push_back({ f.source, f.target });
+        }
+    }
+    m.manifest.resize(0);
+    m.manifest.seek(0);
+    m.manifest.write(plan.manifest);
+    m.manifest.flush();
+    whole.push_back({ m.manifest.fileName(), SpanPlanner::ManifestPath });
+    m.paths = now;
+
+    if (r > 0) {
+        r = addPathspecs(x, whole);
+    }
+    if (r > 0) {
+        r = addParts(x, parts);
+    }
+    qint64 blocks = -1;
+    if (r > 0) {
+        Xorriso_sieve_clear_results(x, 0);
+        XORRISO_OPT(print_size, x, 0);
+    }
+    if (r > 0) {
+        int ac, avail;
+        char **av;
+        Xorriso_sieve_get_result(x, PCHAR("Image size   :"), &ac, &av, &avail, 1);
+        if (ac >= 1) {
+            blocks = QString(av[0]).remove('s').toLongLong();
+        }
+        Xorriso__dispose_words(&ac, &av);
+    }
+    if (blocks < 0) {
+        m.drop();
+    }
+    return blocks;
+}
+
+// the profile key of the media in the drive
+QString DISOMasterPrivate::profileKey()
+{
+    if (!(cachedFields(curdev) & MediaTypeField)) {
+        fetchDeviceProperty(MediaTypeField);
+    }
+    return MediaProfiles::key(deviceProperty(curdev));
+}
+
+int DISOMasterPrivate::chooseWriteSpeed()
+{
+    const DevicePropertyFields missing = (MediaTypeField | WriteSpeedField) & ~cachedFields(curdev);
+    if (missing) {
+        fetchDeviceProperty(missing);
+    }
+    const DeviceProperty p = deviceProperty(curdev);
+    return MediaProfiles::choose(MediaProfiles::instance()->profile(MediaProfiles::key(p)), p.media, p.writespeeds);
+}
+
+// the speed for -speed and cdrecord speed=, with WriteSpeed::Auto resolved
+QString DISOMasterPrivate::speedArgument(int speed)
+{
+    if (speed == WriteSpeed::Auto) {
+        result.autospeed = true;
+        speed = chooseWriteSpeed();
+    }
+    result.writespeed = qMax(speed, 0);
+    return speed > 0 ? QString::number(speed) + "k" : QString("0");
+}
+
+// a burn counts for its speed, a media check for the speed the disc was burnt at
+void DISOMasterPrivate::recordProfile(bool success)
+{
+    if (result.writespeed >= 0) {
+        MediaProfiles::instance()->recordWrite(profilekey, result.writespeed, success && result.mismatches.isEmpty());
+        burnedspeed = success ? result.writespeed : -1;
+    } else if (success) {
+        MediaProfiles::instance()->recordCheck(profilekey, burnedspeed, result.qbad);
+    }
+}
+
+// what was not set goes back to the defaults of xorriso, the handle may come from an earlier job
+int DISOMasterPrivate::applyWriteSettings(const WriteSettings &ws)
+{
+    int r;
+    XORRISO_OPT(stream_recording, xorriso, PCHAR(ws.streamrecording == WriteSettings::StreamOn ? "on" : "off"), 0);
+    if (r > 0) {
+        XORRISO_OPT(fs, xorriso, ws.fifosize > 0 ? QByteArray::number(ws.fifosize).data() : PCHAR("4m"), 0);
+    }
+    if (r > 0) {
+        XORRISO_OPT(padding, xorriso, ws.padding >= 0 ? QByteArray::number(ws.padding).data() : PCHAR("300k"), 0);
+    }
+    if (r > 0) {
+        XORRISO_OPT(dvd_obs, xorriso, ws.obs > 0 ? QByteArray::number(ws.obs).data() : PCHAR("default"), 0);
+    }
+    return r;
+}
+
+/*
+ * A clone shares the data stream of its original, and libisofs writes
+ * the data of a stream only once.
+ */
+int DISOMasterPrivate::shareDuplicates()
+{
+    const QList<Deduplicator::Duplicate> dups = Deduplicator::find(files.entries(true));
+    if (dups.isEmpty()) {
+        return 1;
+    }
+
+    int r;
+    //the paths are literal, not patterns
+    XORRISO_OPT(iso_rr_pattern, xorriso, PCHAR("off"), 0);
+    if (r <= 0) {
+        return r;
+    }
+    for (const Deduplicator::Duplicate &dup : dups) {
+        QByteArray target = dup.target.toUtf8();
+        QByteArray original = dup.original.toUtf8();
+        char *av[] = { target.data() };
+        int idx = 0;
+        XORRISO_OPT(rmi, xorriso, 1, av, &idx, 0);
+        if (r <= 0) {
+            break;
+        }
+        XORRISO_OPT(clone, xorriso, original.data(), target.data(), 0);
+        if (r <= 0) {
+            break;
+        }
+        r = restoreAttributes(dup.source, target);
+        if (r <= 0) {
+            break;
+        }
+        ++result.dedupfiles;
+        result.dedupbytes += dup.size;
+    }
+    const int ret = r;
+    XORRISO_OPT(iso_rr_pattern, xorriso, PCHAR("on"), 0);
+    return qMin(ret, r);
+}
+
+/*
+ * -clone gives the copy the mode, owner and times of the original:
+ * put back those of the local file it was staged from.
+ */
+int DISOMasterPrivate::restoreAttributes(const QString &source, QByteArray &target)
+{
+    struct stat st;
+    if (stat(QFile::encodeName(source).constData(), &st) != 0) {
+        return 1;
+    }
+
+    int r, idx;
+    char *av[] = { target.data() };
+    QByteArray mode = QByteArray::number(st.st_mode & 07777, 8).rightJustified(4, '0');
+    QByteArray uid = QByteArray::number(st.st_uid);
+    QByteArray gid = QByteArray::number(st.st_gid);
+    QByteArray mtime = '=' + QByteArray::number(qint64(st.st_mtim.tv_sec));
+    QByteArray atime = '=' + QByteArray::number(qint64(st.st_atim.tv_sec));
+    idx = 0;
+    XORRISO_OPT(chmodi, xorriso, mode.data(), 1, av, &idx, 0);
+    if (r > 0) {
+        idx = 0;
+        XORRISO_OPT(chowni, xorriso, uid.data(), 1, av, &idx, 0);
+    }
+    if (r > 0) {
+        idx = 0;
+        XORRISO_OPT(chgrpi, xorriso, gid.data(), 1, av, &idx, 0);
+    }
+    if (r > 0) {
+        idx = 0;
+        XORRISO_OPT(alter_date, xorriso, PCHAR("m"), mtime.data(), 1, av, &idx, 0);
+    }
+    if (r > 0) {
+        idx = 0;
+        XORRISO_OPT(alter_date, xorriso, PCHAR("a"), atime.data(), 1, av, &idx, 0);
+    }
+    return r;
+}
+
+/*
+ * Start LBA of the last session on the media, from a fresh -toc;
+ * -1 if there is none.
+ */
+qint64 DISOMasterPrivate::lastSessionStart()
+{
+    int r, ac, avail;
+    char **av;
+
+    Xorriso_sieve_clear_results(xorriso, 0);
+    XORRISO_OPT(toc, xorriso, 0);
+    if (r <= 0) {
+        return -1;
+    }
+
+    //"ISO session  :" number , start lba , blocks , volume id
+    qint64 start = -1;
+    do {
+        Xorriso_sieve_get_result(xorriso, PCHAR("ISO session  :"), &ac, &av, &avail, 0);
+        if (ac == 4) {
+            start = atoll(av[1]);
+        }
+        Xorriso__dispose_words(&ac, &av);
+    } while (avail > 0);
+    return start;
+}
+
+/*
+ * After an incremental commit: files whose data lies in the new session
+ * were written, the others were left where older sessions put them.
+ */
+int DISOMasterPrivate::countDelta(qint64 startlba)
+{
+    int r, ac, avail;
+    char **av;
+
+    for (const StagingTree::Entry &e : files.entries(true)) {
+        QByteArray target = e.second.toUtf8();
+        char *args[] = { target.data(), PCHAR("-type"), PCHAR("f"), PCHAR("-exec"), PCHAR("report_lba") };
+        int idx = 0;
+        XORRISO_OPT(find, xorriso, 5, args, &idx, 0);
+        if (r <= 0) {
+            return r;
+        }
+
+        //"File data lba:" extent , start lba , blocks , bytes , path
+        do {
+            Xorriso_sieve_get_result(xorriso, PCHAR("File data lba:"), &ac, &av, &avail, 0);
+            if (ac == 5) {
+                const bool first = atoi(av[0]) == 0;
+                const qint64 bytes = atoll(av[3]);
+                if (atoll(av[1]) >= startlba) {
+                    result.updatedfiles += first;
+                    result.updatedbytes += bytes;
+                } else {
+                    result.skippedfiles += first;
+                    result.skippedbytes += bytes;
+                }
+            }
+            Xorriso__dispose_words(&ac, &av);
+        } while (avail > 0);
+        Xorriso_sieve_clear_results(xorriso, 0);
+    }
+    return 1;
+}
+
+/*
+ * Read the session written from startlba back once, checking it against
+ * its session MD5. Only if that fails are the files checked one by one,
+ * to name the ones that do not match.
+ */
+int DISOMasterPrivate::verifySession(qint64 startlba)
+{
+    Q_Q(DISOMaster);
+    int r, ac, avail;
+    int dummy = 0;
+    char **av;
+
+    Q_EMIT q->jobStatusChanged(DISOMaster::JobStatus::Verifying, 0);
+    {
+        QMutexLocker locker(&proglock);
+        prog.phase = JobProgress::Verifying;
+        prog.percent = 0;
+        prog.bytesdone = prog.bytestotal = 0;
+        prog.eta = -1;
+    }
+    publishProgress(true);
+
+    //the media changed under the cache
+    q->nullifyDevicePropertyCache(curdev);
+    const qint64 end = qint64(q->getDeviceProperty(CapacityField).datablocks);
+    scanbase = 0;
+    scantotal = qMax<qint64>(end - startlba, 0);
+
+    QByteArray minlba = "min_lba=" + QByteArray::number(startlba);
+    QByteArray abortarg = "abort_file=" + QFile::encodeName(abortfile);
+    char *args[] = { PCHAR("md5=on"), minlba.data(), abortarg.data() };
+    XORRISO_OPT(check_media, xorriso, 3, args, &dummy, 0);
+    if (r <= 0 || cancelrequested) {
+        return 0;
+    }
+
+    bool ok = true;
+    do {
+        Xorriso_sieve_get_result(xorriso, PCHAR("Media region :"), &ac, &av, &avail, 0);
+        if (ac == 3 && av[2][0] == '-') {
+            ok = false;
+        }
+        Xorriso__dispose_words(&ac, &av);
+    } while (avail > 0);
+    Xorriso_sieve_clear_results(xorriso, 0);
+
+    if (!ok) {
+        //bit0: summary, bit3: recursive (-check_md5_r). Mismatches come as messages.
+        char *md5args[] = { PCHAR("SORRY"), PCHAR("/") };
+        dummy = 0;
+        XORRISO_OPT(check_md5, xorriso, 2, md5args, &dummy, 1 | 8);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Fetch the given property groups of the current device into the cache.
+ *
+ * Media type, capacity, blank status and volume id come from the
+ * sieve records of the last -dev / -toc run (re-run -toc if there are
+ * none); each of them is a single sieve query. Write speeds need a
+ * -list_speeds run and are only fetched when asked for.
+ */
+void DISOMasterPrivate::fetchDeviceProperty(DevicePropertyFields fields)
+{
+    if (!curdev.length()) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    //fill a copy, other threads may read the cache meanwhile
+    DeviceProperty p = deviceProperty(curdev);
+    p.devid = curdev;
+    DevicePropertyFields fetched;
+
+    int r, ac, avail;
+    char **av = nullptr;
+    if (fields & (MediaTypeField | CapacityField | BlankStatusField | VolumeIdField)) {
+        Xorriso_sieve_get_result(xorriso, PCHAR("Media current:"), &ac, &av, &avail, 1 | 2);
+        if (avail <= 0) {
+            XORRISO_OPT(toc, xorriso, 0);
+        }
+    }
+
+    if (fields & MediaTypeField) {
+        Xorriso_sieve_get_result(xorriso, PCHAR("Media current:"), &ac, &av, &avail, 1);
+        if (ac < 1) {
+            Xorriso__dispose_words(&ac, &av);
+            setDeviceProperty(curdev, p, fetched);
+            propertylatency = timer.nsecsElapsed() / 1000;
+            return;
+        }
+        p.media = mediaTypeFromString(av[0]);
+        Xorriso__dispose_words(&ac, &av);
+        Xorriso_sieve_get_result(xorriso, PCHAR("Media product:"), &ac, &av, &avail, 1);
+        p.mediaproduct = ac == 2 ? QString(av[0]) : QString();
+        p.manufacturer = ac == 2 ? QString(av[1]) : QString();
+        Xorriso__dispose_words(&ac, &av);
+        fetched |= MediaTypeField;
+    }
+
+    if (fields & CapacityField) {
+        Xorriso_sieve_get_result(xorriso, PCHAR("Media summary:"), &ac, &av, &avail, 1);
+        if (ac == 4) {
+            const QString units = "kmg";
+            p.datablocks = atoll(av[1]);
+            p.data = atof(av[2]) * (1 << ((units.indexOf(*(QString(av[2]).rbegin())) + 1) * 10));
+            p.avail = atof(av[3]) * (1 << ((units.indexOf(*(QString(av[3]).rbegin())) + 1) * 10));
+            fetched |= CapacityField;
+        }
+        Xorriso__dispose_words(&ac, &av);
+    }
+
+    if (fields & BlankStatusField) {
+        Xorriso_sieve_get_result(xorriso, PCHAR("Media status :"), &ac, &av, &avail, 1);
+        if (ac == 1) {
+            p.formatted = QString(av[0]).contains("is blank");
+            fetched |= BlankStatusField;
+        }
+        Xorriso__dispose_words(&ac, &av);
+    }
+
+    if (fields & VolumeIdField) {
+        Xorriso_sieve_get_result(xorriso, PCHAR("Volume id    :"), &ac, &av, &avail, 1);
+        if (ac == 1) {
+            p.volid = QString(av[0]);
+            fetched |= VolumeIdField;
+        }
+        Xorriso__dispose_words(&ac, &av);
+    }
+
+    if (fields & WriteSpeedField) {
+        XORRISO_OPT(list_speeds, xorriso, 0);
+        if (r > 0) {
+            p.writespeed.clear();
+            p.writespeeds.clear();
+            do {
+                Xorriso_sieve_get_result(xorriso, PCHAR("Write speed  :"), &ac, &av, &avail, 0);
+                if (ac == 2) {
+                    p.writespeed.push_back(QString(av[0]) + '\t' + QString(av[1]));
+                    p.writespeeds.push_back(writeSpeedFromStrings(av[0], av[1]));
+                }
+                Xorriso__dispose_words(&ac, &av);
+            } while (avail > 0);
+            std::sort(p.writespeeds.begin(), p.writespeeds.end(), [](const WriteSpeed &a, const WriteSpeed &b) {
+                return a.kbps < b.kbps;
+            });
+            fetched |= WriteSpeedField;
+
+            //drop the speed records; media records will come back from -toc
+            Xorriso_sieve_clear_results(xorriso, 0);
+        }
+    }
+
+    setDeviceProperty(curdev, p, fetched);
+    propertylatency = timer.nsecsElapsed() / 1000;
+}
+
+// get a handle from the pool unless one is held already
+bool DISOMasterPrivate::lease()
+{
+    if (pooled) {
+        return true;
+    }
+    pooled = XorrisoPool::instance()->lease(this, receive);
+    xorriso = pooled ? pooled->xorriso : nullptr;
+    return pooled;
+}
+
+void DISOMasterPrivate::giveBack()
+{
+    if (!pooled) {
+        return;
+    }
+    XorrisoPool::instance()->giveBack(pooled);
+    pooled = nullptr;
+    xorriso = nullptr;
+}
+
+void DISOMasterPrivate::setCurrentDevice(const QString &devid)
+{
+    QWriteLocker locker(&devlock);
+    curdev = devid;
+}
+
+DeviceProperty DISOMasterPrivate::deviceProperty(const QString &devid) const
+{
+    QReadLocker locker(&devlock);
+    return dev.value(devid);
+}
+
+void DISOMasterPrivate::setDeviceProperty(const QString &devid, const DeviceProperty &p, DevicePropertyFields fetched)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QWriteLocker locker(&devlock);
+    dev[devid] = p;
+    QHash<int, qint64> &stamps = devstamp[devid];
+    for (int f = MediaTypeField; f <= WriteSpeedField; f <<= 1) {
+        if (fetched.testFlag(DevicePropertyField(f))) {
+            stamps[f] = now;
+        }
+    }
+}
+
+DevicePropertyFields DISOMasterPrivate::cachedFields(const QString &devid) const
+{
+    QReadLocker locker(&devlock);
+    DevicePropertyFields ret;
+    const QHash<int, qint64> stamps = devstamp.value(devid);
+    for (auto it = stamps.cbegin(); it != stamps.cend(); ++it) {
+        ret |= DevicePropertyField(it.key());
+    }
+    return ret;
+}
+
+/*
+ * Called from the device monitor thread. Entries are keyed by whatever
+ * identifier the caller used, so compare the resolved device nodes.
+ */
+void DISOMasterPrivate::deviceEvent(const QString &devnode, int event)
+{
+    Q_Q(DISOMaster);
+    QStringList changed;
+    QString current;
+    {
+        QWriteLocker locker(&devlock);
+        current = curdev;
+        for (auto it = dev.begin(); it != dev.end();) {
+            const QString node = QFileInfo(it.key()).canonicalFilePath();
+            if (it.key() == devnode || node == devnode) {
+                changed.push_back(it.key());
+                devstamp.remove(it.key());
+                it = dev.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (changed.isEmpty() && (current == devnode || QFileInfo(current).canonicalFilePath() == devnode)) {
+        changed.push_back(current);
+    }
+    if (changed.contains(current)) {
+        burnedspeed = -1;
+    }
+    for (const QString &id : changed) {
+        Q_EMIT q->deviceChanged(id, DISOMaster::DeviceEvent(event));
+    }
+}
+
+void DISOMasterPrivate::receive(void *owner, int channel, char *text)
+{
+    static_cast<DISOMasterPrivate *>(owner)->messageReceived(channel, text);
+}
+
+void DISOMasterPrivate::messageReceived(int type, char *text)
+{
+    QString msg(text);
+    msg = msg.trimmed();
+
+    log.append(MessageLog::parse(type, msg));
+
+    const XorrisoMessage m = XorrisoMessage::classify(msg);
+    watcher.post(m);
+    if (m.type == XorrisoMessage::PhaseChange) {
+        reportStatus(DISOMaster::JobStatus::Stalled, m.phase == XorrisoMessage::ClosingSession ? 1 : 0);
+        if (m.phase == XorrisoMessage::ClosingSession) {
+            {
+                QMutexLocker locker(&proglock);
+                prog.phase = JobProgress::Closing;
+                prog.eta = -1;
+            }
+            publishProgress(true);
+        }
+        return;
+    }
+
+    bool progressed = true;
+    double percent = -1;
+    qint64 done = 0;
+    qint64 total = 0;
+    switch (m.type) {
+    case XorrisoMessage::PercentDone:
+        percent = m.done;
+        break;
+    case XorrisoMessage::MBWritten:
+        if (m.total > 0) {
+            percent = 100. * m.done / m.total;
+            done = qint64(m.done) << 20;
+            total = qint64(m.total) << 20;
+        }
+        break;
+    case XorrisoMessage::BlocksRead:
+        if (const quint64 blocks = scantotal) {
+            const qint64 base = scanbase;
+            percent = 100. * (base + m.done) / blocks;
+            done = (base + qint64(m.done)) * 2048;
+            total = qint64(blocks) * 2048;
+        }
+        break;
+    case XorrisoMessage::Completion:
+        if (!verifying) {
+            reportStatus(DISOMaster::JobStatus::Finished, 0);
+        }
+        break;
+    case XorrisoMessage::MD5Mismatch:
+        progressed = false;
+        break;
+    default:
+        progressed = m.fifo >= 0 || !m.speed.isEmpty();
+        break;
+    }
+
+    if (percent >= 0) {
+        reportStatus(verifying ? DISOMaster::JobStatus::Verifying : DISOMaster::JobStatus::Running, int(percent));
+    }
+    if (progressed) {
+        {
+            QMutexLocker locker(&proglock);
+            if (percent >= 0) {
+                prog.percent = percent;
+            }
+            if (total > 0) {
+                prog.bytesdone = done;
+                prog.bytestotal = total;
+            }
+            if (m.fifo >= 0) {
+                prog.fifo = m.fifo;
+                prog.buffer = m.buffer;
+            }
+            if (!m.speed.isEmpty()) {
+                prog.speed = m.speed.left(m.speed.size() - 1).toDouble();
+            }
+        }
+        publishProgress(false);
+    }
+}
+
+}
+
 /*
  * xorriso -devices
  * xorriso -dev * -toc
@@ -6,7 +6,10 @@
 #define DISOMASTER_H
 
 #include <QObject>
+#include <QDateTime>
+#include <QFuture>
 #include <QHash>
+#include <QIODevice>
 #include <QList>
 #include <QUrl>
 
@@ -33,15 +36,58 @@ enum MediaType
 enum BurnOption
 {
     KeepAppendable = 1,
-    VerifyDatas = 1 << 1,
+    VerifyDatas = 1 << 1,           // read the session back and check its MD5 after burning
     EjectDisc = 1 << 2,             // not used yet.
     ISO9660Only = 1 << 3,           // default
     JolietSupport = 1 << 4,         // add joliet extension
     RockRidgeSupport = 1 << 5,      // add rockridge extension
     JolietAndRockRidge = 1 << 6,    // add both of them, not used yet
+    Incremental = 1 << 7,           // only write files that changed since the loaded session
+    IncrementalMD5 = 1 << 8,        // with Incremental, compare content and recorded MD5s, not inode numbers
+    Deduplicate = 1 << 9,           // write identical staged files only once (not with Incremental)
+    Preallocate = 1 << 10,          // buildImage: reserve the disk space of the image first
 };
 Q_DECLARE_FLAGS(BurnOptions, BurnOption)
 
+enum DumpOption
+{
+    DumpMD5 = 1,            // compute the MD5 digest while dumping
+    DumpSHA256 = 1 << 1,    // compute the SHA-256 digest while dumping
+    DumpSparse = 1 << 2     // leave zero-filled and unreadable spans as holes
+};
+Q_DECLARE_FLAGS(DumpOptions, DumpOption)
+
+enum SpanOption
+{
+    KeepDirectories = 1,            // keep the files of a directory on one disc where they fit
+    SplitLargeFiles = 1 << 1        // cut files bigger than a disc into parts, one per disc
+};
+Q_DECLARE_FLAGS(SpanOptions, SpanOption)
+
+enum DevicePropertyField
+{
+    MediaTypeField = 1,             // media
+    CapacityField = 1 << 1,         // data, avail and datablocks
+    BlankStatusField = 1 << 2,      // formatted
+    VolumeIdField = 1 << 3,         // volid
+    WriteSpeedField = 1 << 4,       // writespeed, requires a drive query
+    AllFields = 0x1f
+};
+Q_DECLARE_FLAGS(DevicePropertyFields, DevicePropertyField)
+
+struct WriteSpeed
+{
+    enum
+    {
+        Auto = -1,      // picked for the media, see DISOMaster::chooseWriteSpeed()
+        Max = 0         // the fastest the drive offers
+    };
+    /** \brief Speed in kilobytes (1000 bytes) per second.*/
+    int kbps = 0;
+    /** \brief Speed as a multiple of the base speed of the media, 0 if unknown.*/
+    double multiple = 0;
+};
+
 struct DeviceProperty
 {
     /** \brief True when the media in device is blank or false otherwise.*/
@@ -54,14 +100,202 @@ struct DeviceProperty
     quint64 avail;
     /** \brief Size of on-disc data in number of blocks.*/
     quint64 datablocks;
-    /** \brief List of write speeds supported, e.g. "10.0x".*/
+    /** \brief List of write speeds supported as reported by xorriso, e.g. "11080k\t8.0xD".*/
     QList<QString> writespeed;
+    /** \brief Write speeds supported, slowest first.*/
+    QList<WriteSpeed> writespeeds;
+    /** \brief Manufacturer and product id of the media, empty if the drive does not report them.*/
+    QString manufacturer;
+    QString mediaproduct;
     /** \brief Device identifier. Empty if the device property is invalid.*/
     QString devid;
     /** \brief Volume name of the disc.*/
     QString volid;
 };
 
+struct MediaRegion
+{
+    enum Quality
+    {
+        Good,
+        Slow,       // readable, but slowly
+        Bad,        // unreadable
+        Untested
+    };
+    /** \brief First block of the region.*/
+    qint64 start = 0;
+    /** \brief Number of blocks in the region.*/
+    qint64 length = 0;
+    Quality quality = Untested;
+};
+
+struct LogMessage
+{
+    enum Severity
+    {
+        Debug,
+        Update,
+        Note,
+        Hint,
+        Warning,
+        Sorry,
+        Failure,
+        Fatal
+    };
+    enum Category
+    {
+        ResultCategory = 1,     // results of commands
+        InfoCategory = 1 << 1,  // info messages
+        ProgressCategory = 1 << 2,  // pacifier updates (severity Update)
+        AllCategories = 0x7
+    };
+    Q_DECLARE_FLAGS(Categories, Category)
+
+    /** \brief Time the message arrived, in milliseconds since epoch.*/
+    qint64 timestamp = 0;
+    Severity severity = Note;
+    Category category = InfoCategory;
+    QString text;
+};
+
+struct JobProgress
+{
+    enum Phase
+    {
+        Idle,
+        Writing,
+        Closing,        // closing track / session
+        Blanking,
+        Reading,        // checkmedia, dumpISO
+        Verifying
+    };
+    Phase phase = Idle;
+    /** \brief Progress of the phase in percentage.*/
+    double percent = 0;
+    /** \brief Bytes done / to do in the phase, 0 if unknown.*/
+    qint64 bytesdone = 0;
+    qint64 bytestotal = 0;
+    /** \brief Fill level of the libburn FIFO / of the drive buffer in percentage, -1 if unknown.*/
+    int fifo = -1;
+    int buffer = -1;
+    /** \brief Current speed as a multiple of the base speed of the media, 0 if unknown.*/
+    double speed = 0;
+    /** \brief Time since the job started, and estimated time to the end of the phase, in milliseconds. -1 if unknown.*/
+    qint64 elapsed = 0;
+    qint64 eta = -1;
+};
+
+struct WriteSettings
+{
+    enum StreamRecording
+    {
+        StreamDefault = -1,
+        StreamOff,      // the default of xorriso
+        StreamOn        // no drive-side defect management (BD, DVD-RAM)
+    };
+    StreamRecording streamrecording = StreamDefault;
+    /** \brief Size of the libburn FIFO in bytes, 0 for the default of xorriso (4 MiB).*/
+    qint64 fifosize = 0;
+    /** \brief Bytes of padding after the data, -1 for the default of xorriso (300 KiB).*/
+    qint64 padding = -1;
+    /** \brief Bytes per write transaction on DVD and BD (32k or 64k), 0 for the default of xorriso.*/
+    int obs = 0;
+
+    static WriteSettings forMedia(MediaType media);
+};
+
+struct JobResult
+{
+    /** \brief True if the job completed successfully.*/
+    bool success = false;
+    /** \brief Wall-clock time the job took, in milliseconds.*/
+    qint64 elapsed = 0;
+    /** \brief Time spent building the ISO tree from staged files, in milliseconds.*/
+    qint64 treebuildtime = 0;
+    /** \brief Portion of good / slow / bad sectors, only set by checkmedia.*/
+    double qgood = 0;
+    double qslow = 0;
+    double qbad = 0;
+    /** \brief Regions checked, sorted and merged, only set by checkmedia.*/
+    QList<MediaRegion> regions;
+    /** \brief Digests of the image, only set by dumpISO when asked for.*/
+    QByteArray md5;
+    QByteArray sha256;
+    /** \brief Digests of each chunk of the image, only set by dumpISO when asked for.*/
+    QList<QByteArray> chunkmd5;
+    QList<QByteArray> chunksha256;
+    /** \brief Size of the image written by dumpISO, in bytes.*/
+    qint64 dumpsize = 0;
+    /** \brief Lowest fill level of the libburn FIFO seen while writing, in percentage. -1 if none.*/
+    int minfifo = -1;
+    /** \brief Files that failed verification, only set by commit with VerifyDatas.*/
+    QStringList mismatches;
+    /** \brief Files (and their bytes) written / left in older sessions, only set by an incremental commit.*/
+    int updatedfiles = 0;
+    qint64 updatedbytes = 0;
+    int skippedfiles = 0;
+    qint64 skippedbytes = 0;
+    /** \brief Staged files (and their bytes) sharing the data of an identical one, only set by commit with Deduplicate.*/
+    int dedupfiles = 0;
+    qint64 dedupbytes = 0;
+    /** \brief Bytes per second written, only set by buildImage.*/
+    double throughput = 0;
+    /** \brief Write speed asked for in kilobytes per second, 0 for the fastest. -1 if the job did not burn.*/
+    int writespeed = -1;
+    /** \brief True if writespeed was picked by WriteSpeed::Auto.*/
+    bool autospeed = false;
+    /** \brief True if the job was stopped by cancel().*/
+    bool cancelled = false;
+    /** \brief Time from cancel() until the drive was held again, in milliseconds. -1 if not cancelled.*/
+    qint64 teardowntime = -1;
+};
+
+struct SpanFile
+{
+    /** \brief Local path, and path on the disc. Empty directories are listed too.*/
+    QString source;
+    QString target;
+    /** \brief Bytes of the local file on the disc, from offset on.*/
+    qint64 offset = 0;
+    qint64 length = 0;
+    /** \brief Number of the part (from 1) and number of parts of a split file, 0 if the file is whole.*/
+    int part = 0;
+    int parts = 0;
+};
+
+/*!
+ * \brief One disc of a set planned by DISOMaster::planSpanning().
+ */
+struct DiscPlan
+{
+    /** \brief Number of the disc in the set, from 1.*/
+    int disc = 0;
+    /** \brief Files on the disc, sorted by path on the disc.*/
+    QList<SpanFile> files;
+    /** \brief Bytes of file data on the disc.*/
+    qint64 databytes = 0;
+    /** \brief Size of the image in blocks of 2048 bytes as xorriso computes it, file system and manifest included.*/
+    qint64 blocks = 0;
+    /** \brief Index of the disc, also written to it as /.disomaster-span: the set, the disc and its files.*/
+    QByteArray manifest;
+};
+
+struct DeviceInfo
+{
+    /** \brief Device identifier, e.g. "/dev/sr0".*/
+    QString devid;
+    /** \brief Identity of the drive as reported by the drive itself.*/
+    QString vendor;
+    QString product;
+    QString revision;
+    /** \brief False if the drive could not be probed, e.g. because it is in use.*/
+    bool available = false;
+    /** \brief True if there is a media in the drive.*/
+    bool hasmedia = false;
+    /** \brief Type of media currently in the drive.*/
+    MediaType media = NoMedia;
+};
+
 class DISOMasterPrivate;
 class DISOMaster : public QObject
 {
@@ -73,43 +307,129 @@ public:
         Idle,
         Running,
         Stalled,
-        Finished
+        Finished,
+        Verifying,      // reading back what was written, progress in percentage
+        Paused,         // see pause()
+        Cancelled       // see cancel()
     };
     Q_ENUM(JobStatus)
 
+    enum DeviceEvent
+    {
+        DeviceAdded,
+        DeviceRemoved,
+        MediaChanged
+    };
+    Q_ENUM(DeviceEvent)
+
     explicit DISOMaster(QObject *parent = nullptr);
     ~DISOMaster();
 
+    static QList<DeviceInfo> listDevices(bool refresh = false);
+    static void prewarmHandles(int count);
+    static void setIdleHandleLimit(int count);
+    static int idleHandles();
     bool acquireDevice(QString dev);
     void releaseDevice();
     QString currentDevice() const;
 
     DeviceProperty getDeviceProperty();
+    DeviceProperty getDeviceProperty(DevicePropertyFields fields);
+    QDateTime devicePropertyTimestamp(QString dev, DevicePropertyField field) const;
+    qint64 devicePropertyLatency() const;
+    qint64 constructionLatency() const;
+    qint64 acquireLatency() const;
     DeviceProperty getDevicePropertyCached(QString dev) const;
     void nullifyDevicePropertyCache(QString dev);
 
     QStringList getInfoMessages();
+    QList<LogMessage> takeLogMessages();
+    quint64 droppedLogMessages() const;
+    void setLogFilter(LogMessage::Categories categories, LogMessage::Severity minseverity = LogMessage::Debug);
+    void setLogToStderr(bool on);
     QString getCurrentSpeed() const;
+    JobProgress progress() const;
+    void setProgressInterval(int msecs);
+
+    void setWriteSettings(const WriteSettings &settings);
+    WriteSettings writeSettings() const;
+    int chooseWriteSpeed();
+    static void setMediaProfileDatabase(const QString &path);
+    static QString mediaProfileDatabase();
 
     void stageFiles(const QHash<QUrl, QUrl> filelist);
-    const QHash<QUrl, QUrl> &stagingFiles() const;
+    QHash<QUrl, QUrl> stagingFiles() const;
     void removeStagingFiles(const QList<QUrl> filelist);
+    int removeStagingTree(const QUrl dir);
+    quint64 stagingMemoryUsage() const;
+    QList<DiscPlan> planSpanning(qint64 capacity = 0, SpanOptions opts = KeepDirectories,
+                                 const BurnOptions &burnopts = BurnOptions(), QString volId = "ISOIMAGE");
+    void stageDiscPlan(const DiscPlan &plan);
     bool commit(const BurnOptions &opts, int speed = 0, QString volId = "ISOIMAGE");
     Q_DECL_DEPRECATED_X("Suggest use commit with BurnOptions instead") bool commit(int speed = 0, bool closeSession = false, QString volId = "ISOIMAGE");
     bool erase();
     bool checkmedia(double *qgood, double *qslow, double *qbad);
-    bool dumpISO(const QUrl isopath);
-    bool writeISO(const QUrl isopath, int speed = 0);
+    bool checkmediaRange(qint64 startlba, qint64 blocks = -1, bool stoponbad = false);
+    bool dumpISO(const QUrl isopath, const DumpOptions &opts = DumpOptions(), qint64 chunksize = 0);
+    bool buildImage(const QUrl target, const BurnOptions &opts = BurnOptions(), QString volId = "ISOIMAGE");
+    bool writeISO(const QUrl isopath, int speed = 0, qint64 size = 0);
+    bool writeISO(int fd, qint64 size, int speed = 0);
+    bool writeISO(QIODevice *source, qint64 size, int speed = 0);
+    JobResult lastJobResult() const;
+
+    void cancel();
+    bool pause();
+    void resume();
+    bool isPaused() const;
+
+    QFuture<JobResult> commitAsync(const BurnOptions &opts, int speed = 0, QString volId = "ISOIMAGE");
+    QFuture<JobResult> eraseAsync();
+    QFuture<JobResult> checkmediaAsync();
+    QFuture<JobResult> checkmediaRangeAsync(qint64 startlba, qint64 blocks = -1, bool stoponbad = false);
+    QFuture<JobResult> dumpISOAsync(const QUrl isopath, const DumpOptions &opts = DumpOptions(), qint64 chunksize = 0);
+    QFuture<JobResult> buildImageAsync(const QUrl target, const BurnOptions &opts = BurnOptions(), QString volId = "ISOIMAGE");
+    QFuture<JobResult> writeISOAsync(const QUrl isopath, int speed = 0, qint64 size = 0);
+    QFuture<JobResult> writeISOAsync(int fd, qint64 size, int speed = 0);
 
 Q_SIGNALS:
     /**
      * \brief Indicates a change of current job status.
      *
      * \param status Current job status.
-     * \param progress Job progress in percentage if status is running.
+     * \param progress Job progress in percentage if status is running or verifying.
      *        Type of stalled work if status is stalled (1 = closing session, 0 = others).
      */
     void jobStatusChanged(DISOMasterNS::DISOMaster::JobStatus status, int progress);
+    /**
+     * \brief Indicates that a drive was plugged, unplugged, or its media changed.
+     *
+     * Emitted from the device monitor thread for the current device and
+     * for every device with a cached property. The cached property of
+     * dev has already been nullified when this is emitted.
+     */
+    void deviceChanged(QString dev, DISOMasterNS::DISOMaster::DeviceEvent event);
+    /**
+     * \brief Reports a region of the disc checked by checkmedia, while it runs.
+     */
+    void mediaRegionChecked(DISOMasterNS::MediaRegion region);
+    /**
+     * \brief Reports the fill levels while writing.
+     *
+     * Emitted along with progressChanged(), at most once per progress
+     * interval, when a level changed.
+     *
+     * \param fifo fill level of the libburn FIFO in percentage.
+     * \param buffer fill level of the drive buffer in percentage, -1 if unknown.
+     */
+    void bufferFillChanged(int fifo, int buffer);
+    /**
+     * \brief Reports the progress of the current job.
+     *
+     * Emitted only when something changed, and at most once per progress
+     * interval, except for phase changes and the end of the job.
+     * progress() always returns the latest state.
+     */
+    void progressChanged(DISOMasterNS::JobProgress progress);
 
 private:
     QScopedPointer<DISOMasterPrivate> d_ptr;
@@ -118,5 +438,13 @@ private:
 
 }
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(DISOMasterNS::BurnOptions)
+Q_DECLARE_OPERATORS_FOR_FLAGS(DISOMasterNS::DevicePropertyFields)
+Q_DECLARE_OPERATORS_FOR_FLAGS(DISOMasterNS::DumpOptions)
+Q_DECLARE_OPERATORS_FOR_FLAGS(DISOMasterNS::SpanOptions)
+Q_DECLARE_OPERATORS_FOR_FLAGS(DISOMasterNS::LogMessage::Categories)
+Q_DECLARE_METATYPE(DISOMasterNS::MediaRegion)
+Q_DECLARE_METATYPE(DISOMasterNS::JobProgress)
+
 #endif
 // vim: set tabstop=4 shiftwidth=4 softtabstop expandtab
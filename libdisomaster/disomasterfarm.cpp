@@ -0,0 +1,327 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "disomasterfarm.h"
+#include "trackpipe.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <memory>
+#include <thread>
+
+namespace DISOMasterNS {
+
+class DISOMasterFarmPrivate
+{
+private:
+    DISOMasterFarmPrivate(DISOMasterFarm *q)
+        : q_ptr(q) {}
+
+    struct Drive
+    {
+        DISOMaster *master;
+        QString dev;
+        quint64 consumed = 0;   // chunks written to the drive so far
+        bool alive = true;
+        ReplicaResult result;
+    };
+
+    QVector<Drive> drives;
+    QList<ReplicaResult> results;
+    double throughput = 0;
+
+    //ring buffer shared by all drives: chunk n lives in ring[n % ring.size()]
+    //and is only overwritten once every live drive has consumed it.
+    int chunks = 16;
+    int chunksize = 4 << 20;
+    QVector<QByteArray> ring;
+    QVector<int> lens;
+    quint64 produced = 0;
+    bool eof = false;
+    QMutex lock;
+    QWaitCondition changed;
+
+    DISOMasterFarm *q_ptr;
+    Q_DECLARE_PUBLIC(DISOMasterFarm)
+
+    bool produce(QFile &src);
+    void feed(Drive &drv, TrackPipe *pipe, QFuture<JobResult> job);
+    void drop(Drive &drv);
+};
+
+/*!
+ * \class DISOMasterFarm
+ * \brief Burns one image to several drives at once.
+ *
+ * The image is read only once, into a ring buffer shared by all
+ * drives. Each drive is fed through its own pipe by DISOMaster::writeISO,
+ * so drives run in parallel; a drive that fails is dropped without
+ * holding back the others.
+ */
+DISOMasterFarm::DISOMasterFarm(QObject *parent)
+    : QObject(parent),
+      d_ptr(new DISOMasterFarmPrivate(this))
+{
+}
+
+DISOMasterFarm::~DISOMasterFarm()
+{
+    releaseDevices();
+}
+
+/*!
+ * \brief Acquire the drives to replicate to.
+ * \param devs device identifiers, e.g. "/dev/sr0" or "stdio:/tmp/copy.iso"
+ * \return the number of drives acquired.
+ */
+int DISOMasterFarm::acquireDevices(const QStringList &devs)
+{
+    Q_D(DISOMasterFarm);
+    for (const QString &dev : devs) {
+        DISOMaster *m = new DISOMaster;
+        if (!m->acquireDevice(dev)) {
+            delete m;
+            continue;
+        }
+        connect(m, &DISOMaster::jobStatusChanged, this, [this, dev](DISOMaster::JobStatus status, int progress) {
+            Q_EMIT jobStatusChanged(dev, status, progress);
+        }, Qt::DirectConnection);
+        DISOMasterFarmPrivate::Drive drv;
+        drv.master = m;
+        drv.dev = dev;
+        d->drives.push_back(drv);
+    }
+    return d->drives.size();
+}
+
+/*!
+ * \brief Release all drives held.
+ */
+void DISOMasterFarm::releaseDevices()
+{
+    Q_D(DISOMasterFarm);
+    for (auto &drv : d->drives) {
+        drv.master->releaseDevice();
+        delete drv.master;
+    }
+    d->drives.clear();
+}
+
+/*!
+ * \brief Get the drives currently held.
+ */
+QStringList DISOMasterFarm::devices() const
+{
+    Q_D(const DISOMasterFarm);
+    QStringList ret;
+    for (auto &drv : d->drives) {
+        ret.push_back(drv.dev);
+    }
+    return ret;
+}
+
+/*!
+ * \brief Set the size of the shared ring buffer.
+ * \param chunks number of chunks in the ring
+ * \param chunksize size of one chunk in bytes
+ *
+ * The default is 16 chunks of 4 MiB. The buffer absorbs speed
+ * differences between drives: the fastest drive can run ahead
+ * of the slowest one by at most the size of the buffer.
+ */
+void DISOMasterFarm::setBufferSize(int chunks, int chunksize)
+{
+    Q_D(DISOMasterFarm);
+    d->chunks = qMax(chunks, 2);
+    d->chunksize = qMax(chunksize, 64 << 10);
+}
+
+/*!
+ * \brief Burn an image to all drives held.
+ * \param isopath the image file to be burnt.
+ * \param speed the desired write speed in kilobytes per second.
+ * \return true if the image was burnt successfully on at least one drive.
+ *
+ * Per drive results are available from lastResults() afterwards.
+ */
+bool DISOMasterFarm::writeISO(const QUrl isopath, int speed)
+{
+    Q_D(DISOMasterFarm);
+    d->results.clear();
+    d->throughput = 0;
+
+    QFile src(isopath.path());
+    if (d->drives.isEmpty() || !src.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    d->ring.clear();
+    for (int i = 0; i < d->chunks; ++i) {
+        d->ring.push_back(QByteArray(d->chunksize, Qt::Uninitialized));
+    }
+    d->lens.fill(0, d->chunks);
+    d->produced = 0;
+    d->eof = false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    std::vector<std::thread> feeders;
+    std::vector<std::unique_ptr<TrackPipe>> pipes;
+    for (auto &drv : d->drives) {
+        drv.consumed = 0;
+        drv.alive = true;
+        drv.result = ReplicaResult();
+        drv.result.devid = drv.dev;
+
+        pipes.emplace_back(new TrackPipe);
+        TrackPipe *pipe = pipes.back().get();
+        if (!pipe->isValid()) {
+            drv.alive = false;
+            Q_EMIT deviceFailed(drv.dev);
+            continue;
+        }
+
+        QFuture<JobResult> job = drv.master->writeISOAsync(pipe->track(), speed, src.size());
+        feeders.emplace_back([d, &drv, pipe, job] { d->feed(drv, pipe, job); });
+    }
+
+    d->produce(src);
+
+    for (auto &t : feeders) {
+        t.join();
+    }
+    pipes.clear();
+
+    quint64 total = 0;
+    bool ret = false;
+    for (auto &drv : d->drives) {
+        d->results.push_back(drv.result);
+        if (drv.result.success) {
+            total += drv.result.bytes;
+            ret = true;
+        }
+    }
+    d->throughput = 1000. * total / qMax<qint64>(timer.elapsed(), 1);
+
+    return ret;
+}
+
+/*!
+ * \brief Get the per drive results of the last writeISO().
+ */
+QList<ReplicaResult> DISOMasterFarm::lastResults() const
+{
+    Q_D(const DISOMasterFarm);
+    return d->results;
+}
+
+/*!
+ * \brief Get the throughput of the last writeISO() summed over all
+ * drives that succeeded, in bytes per second.
+ */
+double DISOMasterFarm::aggregateThroughput() const
+{
+    Q_D(const DISOMasterFarm);
+    return d->throughput;
+}
+
+// read the image into the ring until it ends or no drive is left
+bool DISOMasterFarmPrivate::produce(QFile &src)
+{
+    QMutexLocker locker(&lock);
+    for (;;) {
+        quint64 slowest;
+        bool anyalive;
+        for (;;) {
+            slowest = produced;
+            anyalive = false;
+            for (const Drive &drv : drives) {
+                if (drv.alive) {
+                    slowest = qMin(slowest, drv.consumed);
+                    anyalive = true;
+                }
+            }
+            if (!anyalive || produced - slowest < quint64(ring.size())) {
+                break;
+            }
+            changed.wait(&lock);
+        }
+        if (!anyalive) {
+            break;
+        }
+
+        //no live drive reads this slot any more
+        const int slot = produced % ring.size();
+        locker.unlock();
+        const qint64 n = src.read(ring[slot].data(), chunksize);
+        locker.relock();
+
+        if (n <= 0) {
+            break;
+        }
+        lens[slot] = n;
+        ++produced;
+        changed.wakeAll();
+    }
+    eof = true;
+    changed.wakeAll();
+    return produced > 0;
+}
+
+void DISOMasterFarmPrivate::feed(Drive &drv, TrackPipe *pipe, QFuture<JobResult> job)
+{
+    Q_Q(DISOMasterFarm);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    bool ok = true;
+    QMutexLocker locker(&lock);
+    for (;;) {
+        while (drv.consumed == produced && !eof) {
+            changed.wait(&lock);
+        }
+        if (drv.consumed == produced) {
+            break;
+        }
+        const int slot = drv.consumed % ring.size();
+        const char *data = ring.at(slot).constData();
+        const int len = lens[slot];
+        locker.unlock();
+        ok = pipe->write(data, len, job);
+        locker.relock();
+        if (!ok) {
+            break;
+        }
+        ++drv.consumed;
+        drv.result.bytes += len;
+        changed.wakeAll();
+    }
+    locker.unlock();
+
+    if (!ok) {
+        drop(drv);
+    }
+    pipe->closeWrite();
+    job.waitForFinished();
+
+    drv.result.success = ok && job.result().success;
+    drv.result.elapsed = timer.elapsed();
+    drv.result.throughput = 1000. * drv.result.bytes / qMax<qint64>(drv.result.elapsed, 1);
+    if (!drv.result.success) {
+        drop(drv);
+        Q_EMIT q->deviceFailed(drv.dev);
+    }
+}
+
+void DISOMasterFarmPrivate::drop(Drive &drv)
+{
+    QMutexLocker locker(&lock);
+    drv.alive = false;
+    changed.wakeAll();
+}
+
+}
@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DISOMASTERFARM_H
+#define DISOMASTERFARM_H
+
+#include "disomaster.h"
+
+namespace DISOMasterNS {
+
+struct ReplicaResult
+{
+    /** \brief Device identifier of the drive.*/
+    QString devid;
+    /** \brief True if the image was burnt successfully on this drive.*/
+    bool success = false;
+    /** \brief Bytes fed to the drive.*/
+    quint64 bytes = 0;
+    /** \brief Time the drive took, in milliseconds.*/
+    qint64 elapsed = 0;
+    /** \brief Average throughput in bytes per second.*/
+    double throughput = 0;
+};
+
+class DISOMasterFarmPrivate;
+class DISOMasterFarm : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DISOMasterFarm(QObject *parent = nullptr);
+    ~DISOMasterFarm();
+
+    int acquireDevices(const QStringList &devs);
+    void releaseDevices();
+    QStringList devices() const;
+
+    void setBufferSize(int chunks, int chunksize);
+    bool writeISO(const QUrl isopath, int speed = 0);
+    QList<ReplicaResult> lastResults() const;
+    double aggregateThroughput() const;
+
+Q_SIGNALS:
+    /**
+     * \brief Indicates a change of job status on one of the drives.
+     *
+     * See DISOMaster::jobStatusChanged().
+     */
+    void jobStatusChanged(QString dev, DISOMasterNS::DISOMaster::JobStatus status, int progress);
+    /**
+     * \brief A drive failed and was dropped from the running job.
+     */
+    void deviceFailed(QString dev);
+
+private:
+    QScopedPointer<DISOMasterFarmPrivate> d_ptr;
+    Q_DECLARE_PRIVATE(DISOMasterFarm)
+};
+
+}
+
+#endif // DISOMASTERFARM_H
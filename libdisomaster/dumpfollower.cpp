@@ -0,0 +1,208 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dumpfollower.h"
+#include <QFile>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DISOMasterNS {
+
+static const qint64 readsize = 1 << 20;
+static const qint64 holesize = 64 << 10;   //punch only whole, aligned spans of this size
+
+DumpFollower::DumpFollower(const QString &path, DumpOptions opts, qint64 chunksize)
+    : path(path),
+      opts(opts),
+      chunksize(chunksize > 0 ? chunksize : 0),
+      fd(-1),
+      offset(0),
+      chunkfill(0),
+      failed(false),
+      writerdone(false)
+{
+    if (opts & DumpMD5) {
+        md5.reset(new QCryptographicHash(QCryptographicHash::Md5));
+        if (this->chunksize) {
+            chunkmd5.reset(new QCryptographicHash(QCryptographicHash::Md5));
+        }
+    }
+    if (opts & DumpSHA256) {
+        sha256.reset(new QCryptographicHash(QCryptographicHash::Sha256));
+        if (this->chunksize) {
+            chunksha256.reset(new QCryptographicHash(QCryptographicHash::Sha256));
+        }
+    }
+}
+
+DumpFollower::~DumpFollower()
+{
+    if (thread.joinable()) {
+        writerdone = true;
+        thread.join();
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+/*!
+ * \brief Create (truncate) the image file and start following it.
+ *
+ * Must be called before xorriso opens the file: it only ever creates
+ * it, so a longer stale file would otherwise be followed to its end.
+ */
+bool DumpFollower::start()
+{
+    fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    thread = std::thread([this] { run(); });
+    return true;
+}
+
+/*!
+ * \brief Consume the rest of the file once the writer is done.
+ * \param expectedsize size of the complete image. A shorter file (the
+ * trailing blocks could not be read) is extended with zeros, as a hole.
+ * \return false if the file could not be read to its end. The digests
+ * are then left out of the job result.
+ */
+bool DumpFollower::finish(bool success, qint64 expectedsize)
+{
+    writerdone = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (!success || fd < 0 || failed) {
+        return false;
+    }
+
+    struct stat st;
+    if (expectedsize > 0 && fstat(fd, &st) == 0 && st.st_size < expectedsize) {
+        if (ftruncate(fd, expectedsize) != 0 || consume(expectedsize) < 0) {
+            failed = true;
+            return false;
+        }
+    }
+    //the last chunk may be short
+    if (chunkfill) {
+        if (chunkmd5) {
+            chunkmd5s.push_back(chunkmd5->result());
+        }
+        if (chunksha256) {
+            chunksha256s.push_back(chunksha256->result());
+        }
+        chunkfill = 0;
+    }
+    return true;
+}
+
+void DumpFollower::fillResult(JobResult &result) const
+{
+    result.dumpsize = offset;
+    if (failed) {
+        return;
+    }
+    if (md5) {
+        result.md5 = md5->result();
+        result.chunkmd5 = chunkmd5s;
+    }
+    if (sha256) {
+        result.sha256 = sha256->result();
+        result.chunksha256 = chunksha256s;
+    }
+}
+
+void DumpFollower::run()
+{
+    for (;;) {
+        //read the flag first: what was there before it was set is complete
+        const bool done = writerdone;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || consume(st.st_size) < 0) {
+            failed = true;
+            return;
+        }
+        if (done) {
+            return;
+        }
+        usleep(20000);
+    }
+}
+
+// hash the file from offset up to upto, return the new offset or -1
+qint64 DumpFollower::consume(qint64 upto)
+{
+    QByteArray buf(int(qMin(readsize, qMax<qint64>(upto - offset, 1))), Qt::Uninitialized);
+    while (offset < upto) {
+        const ssize_t n = pread(fd, buf.data(), size_t(qMin<qint64>(buf.size(), upto - offset)), offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        hash(buf.constData(), n);
+        if (opts & DumpSparse) {
+            punchZeros(buf.constData(), offset, n);
+        }
+        offset += n;
+    }
+    return offset;
+}
+
+void DumpFollower::hash(const char *data, qint64 len)
+{
+    if (md5) {
+        md5->addData(data, int(len));
+    }
+    if (sha256) {
+        sha256->addData(data, int(len));
+    }
+    if (!chunksize) {
+        return;
+    }
+    while (len > 0) {
+        const qint64 n = qMin(len, chunksize - chunkfill);
+        if (chunkmd5) {
+            chunkmd5->addData(data, int(n));
+        }
+        if (chunksha256) {
+            chunksha256->addData(data, int(n));
+        }
+        data += n;
+        len -= n;
+        chunkfill += n;
+        if (chunkfill == chunksize) {
+            if (chunkmd5) {
+                chunkmd5s.push_back(chunkmd5->result());
+                chunkmd5->reset();
+            }
+            if (chunksha256) {
+                chunksha256s.push_back(chunksha256->result());
+                chunksha256->reset();
+            }
+            chunkfill = 0;
+        }
+    }
+}
+
+// the data at off is final (the writer is past it), zeros may become a hole
+void DumpFollower::punchZeros(const char *data, qint64 off, qint64 len)
+{
+    static const QByteArray zeros(int(holesize), '\0');
+    qint64 skip = (holesize - off % holesize) % holesize;
+    for (qint64 i = skip; i + holesize <= len; i += holesize) {
+        if (memcmp(data + i, zeros.constData(), size_t(holesize)) == 0) {
+            fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off + i, holesize);
+        }
+    }
+}
+
+}
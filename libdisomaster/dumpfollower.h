@@ -0,0 +1,55 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DUMPFOLLOWER_H
+#define DUMPFOLLOWER_H
+
+#include "disomaster.h"
+#include <QCryptographicHash>
+#include <QScopedPointer>
+#include <atomic>
+#include <thread>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Hashes an image file while xorriso is still writing it.
+ *
+ * The file is read right behind the writer, so the data comes from the
+ * page cache rather than from the disk. Zero-filled spans can be turned
+ * into holes on the way.
+ */
+class DumpFollower
+{
+public:
+    DumpFollower(const QString &path, DumpOptions opts, qint64 chunksize);
+    ~DumpFollower();
+
+    bool start();
+    bool finish(bool success, qint64 expectedsize);
+    void fillResult(JobResult &result) const;
+
+private:
+    void run();
+    qint64 consume(qint64 upto);
+    void hash(const char *data, qint64 len);
+    void punchZeros(const char *data, qint64 off, qint64 len);
+
+    QString path;
+    DumpOptions opts;
+    qint64 chunksize;
+    int fd;
+    qint64 offset;      // bytes consumed so far
+    qint64 chunkfill;   // bytes of the current chunk consumed so far
+    bool failed;        // a read failed, the digests only cover part of the file
+    std::atomic<bool> writerdone;
+    std::thread thread;
+
+    QScopedPointer<QCryptographicHash> md5, sha256, chunkmd5, chunksha256;
+    QList<QByteArray> chunkmd5s, chunksha256s;
+};
+
+}
+
+#endif // DUMPFOLLOWER_H
@@ -8,6 +8,8 @@ QT       -= gui
 
 TARGET = disomaster
 TEMPLATE = lib
+# the major version is the soname, bump it with every ABI break
+VERSION = 2.0.0
 CONFIG += no_keywords link_pkgconfig create_prl no_install_prl create_pc
 
 DEFINES += DISOMASTER_LIBRARY
@@ -26,10 +28,36 @@ DEFINES += QT_DEPRECATED_WARNINGS
 PKGCONFIG += libisoburn-1
 
 SOURCES += \
-        disomaster.cpp
+        deduplicator.cpp \
+        devicemonitor.cpp \
+        devicescanner.cpp \
+        disomaster.cpp \
+        disomasterfarm.cpp \
+        dumpfollower.cpp \
+        mediaprofiles.cpp \
+        messagelog.cpp \
+        spanplanner.cpp \
+        stagingtree.cpp \
+        trackpipe.cpp \
+        watcherchannel.cpp \
+        xorrisomessage.cpp \
+        xorrisopool.cpp
 
 HEADERS += \
-        disomaster.h
+        deduplicator.h \
+        devicemonitor.h \
+        devicescanner.h \
+        disomaster.h \
+        disomasterfarm.h \
+        dumpfollower.h \
+        mediaprofiles.h \
+        messagelog.h \
+        spanplanner.h \
+        stagingtree.h \
+        trackpipe.h \
+        watcherchannel.h \
+        xorrisomessage.h \
+        xorrisopool.h
 
 isEmpty(PREFIX) {
     PREFIX = /usr
@@ -39,7 +67,7 @@ isEmpty(LIBDIR) {
     LIBDIR = $$PREFIX/lib
 }
 
-includes.files += disomaster.h
+includes.files += disomaster.h disomasterfarm.h
 includes.path = $$PREFIX/include/disomaster
 
 QMAKE_PKGCONFIG_NAME = libdisomaster
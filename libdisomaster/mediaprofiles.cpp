@@ -0,0 +1,307 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mediaprofiles.h"
+#include "xorrisomessage.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLockFile>
+#include <QSaveFile>
+#include <algorithm>
+
+namespace DISOMasterNS {
+
+Q_GLOBAL_STATIC(MediaProfiles, profiledb)
+
+//a speed is not used again once this portion of its burns failed
+static const double FailureRatio = 0.25;
+//or once checkmedia found this portion of bad blocks on its discs
+static const double BadRatio = 0.001;
+//clean burns at the fastest good speed before the next one is tried
+static const int ProbeAfter = 3;
+
+// the fastest speed to start with when nothing is known about a media
+static double defaultCap(MediaType media)
+{
+    switch (media) {
+    case CD_R:
+        return 24;
+    case CD_RW:
+        return 10;
+    case DVD_R:
+    case DVD_PLUS_R:
+        return 8;
+    case DVD_RW:
+    case DVD_PLUS_RW:
+    case DVD_PLUS_R_DL:
+    case BD_R:
+        return 4;
+    case DVD_RAM:
+        return 3;
+    case BD_RE:
+        return 2;
+    default:
+        return 0;   //no cap
+    }
+}
+
+static MediaProfiles::SpeedRecord record(const MediaProfiles::Profile &p, int kbps)
+{
+    for (const MediaProfiles::SpeedRecord &r : p.speeds) {
+        if (r.kbps == kbps) {
+            return r;
+        }
+    }
+    MediaProfiles::SpeedRecord r;
+    r.kbps = kbps;
+    return r;
+}
+
+static bool isBad(const MediaProfiles::SpeedRecord &r)
+{
+    return (r.failures > 0 && r.failures >= r.jobs * FailureRatio)
+            || (r.checks > 0 && r.qbad / r.checks > BadRatio);
+}
+
+MediaProfiles::MediaProfiles()
+{
+}
+
+MediaProfiles *MediaProfiles::instance()
+{
+    return profiledb();
+}
+
+/*!
+ * \brief The profile key of the media described by p, e.g. "DVD+R/CMC MAG/M01".
+ */
+QString MediaProfiles::key(const DeviceProperty &p)
+{
+    return mediaTypeToString(p.media) + '/' + p.manufacturer + '/' + p.mediaproduct;
+}
+
+/*!
+ * \brief Keep the database in path. An empty path keeps it in memory only.
+ */
+void MediaProfiles::setPath(const QString &path)
+{
+    QMutexLocker locker(&lock);
+    file = path;
+    profiles.clear();
+}
+
+QString MediaProfiles::path() const
+{
+    QMutexLocker locker(&lock);
+    return file;
+}
+
+MediaProfiles::Profile MediaProfiles::profile(const QString &key)
+{
+    QMutexLocker locker(&lock);
+    load();
+    return profiles.value(key);
+}
+
+/*!
+ * \brief Count a burn at kbps, bad if it failed or did not verify.
+ */
+void MediaProfiles::recordWrite(const QString &key, int kbps, bool good)
+{
+    QMutexLocker locker(&lock);
+    QLockFile flock(file + ".lock");
+    lockFile(flock);
+    load();
+    SpeedRecord *r = find(profiles[key], kbps);
+    r->jobs++;
+    r->failures += good ? 0 : 1;
+    save();
+}
+
+/*!
+ * \brief Count a checkmedia run that found the portion qbad of bad
+ * blocks, on a disc burnt at kbps (-1 if unknown).
+ */
+void MediaProfiles::recordCheck(const QString &key, int kbps, double qbad)
+{
+    QMutexLocker locker(&lock);
+    QLockFile flock(file + ".lock");
+    lockFile(flock);
+    load();
+    Profile &p = profiles[key];
+    if (kbps < 0) {
+        p.checks++;
+        p.qbad += qbad;
+    } else {
+        SpeedRecord *r = find(p, kbps);
+        r->checks++;
+        r->qbad += qbad;
+    }
+    save();
+}
+
+/*!
+ * \brief Pick a write speed from the speeds the drive offers and what
+ * the profile of the media says about them.
+ *
+ * The slowest speed that turned out bad rules out itself and all
+ * faster ones. Below it, the fastest speed with clean burns is used,
+ * or the next faster one once it has a few of them. Without any
+ * history, the fastest speed up to a conservative default of the media
+ * type is used. Media that reads back badly at unknown speeds is burnt
+ * one step slower.
+ *
+ * \return the speed in kilobytes per second, 0 for the fastest of the drive.
+ */
+int MediaProfiles::choose(const Profile &p, MediaType media, QList<WriteSpeed> speeds)
+{
+    if (speeds.isEmpty()) {
+        //no speed list (e.g. a stdio: drive): the speeds used before
+        for (const SpeedRecord &r : p.speeds) {
+            if (r.kbps > 0) {
+                WriteSpeed ws;
+                ws.kbps = r.kbps;
+                speeds.push_back(ws);
+            }
+        }
+    }
+    std::sort(speeds.begin(), speeds.end(), [](const WriteSpeed &a, const WriteSpeed &b) {
+        return a.kbps < b.kbps;
+    });
+    speeds.erase(std::unique(speeds.begin(), speeds.end(), [](const WriteSpeed &a, const WriteSpeed &b) {
+        return a.kbps == b.kbps;
+    }), speeds.end());
+    if (speeds.isEmpty()) {
+        return WriteSpeed::Max;
+    }
+
+    int limit = speeds.size();
+    int good = -1;
+    for (int i = 0; i < speeds.size(); ++i) {
+        const SpeedRecord r = record(p, speeds[i].kbps);
+        if (isBad(r)) {
+            limit = i;
+            break;
+        }
+        if (r.jobs > 0) {
+            good = i;
+        }
+    }
+    if (limit == 0) {
+        return speeds.first().kbps;
+    }
+
+    int pick = 0;
+    if (good >= 0) {
+        pick = good;
+        const SpeedRecord r = record(p, speeds[good].kbps);
+        if (r.jobs - r.failures >= ProbeAfter && good + 1 < limit) {
+            pick = good + 1;
+        }
+    } else {
+        const double cap = defaultCap(media);
+        for (int i = 0; i < limit; ++i) {
+            if (!cap || speeds[i].multiple <= 0 || speeds[i].multiple <= cap) {
+                pick = i;
+            }
+        }
+    }
+    if (p.checks > 0 && p.qbad / p.checks > BadRatio) {
+        pick = qMax(pick - 1, 0);
+    }
+    return speeds[pick].kbps;
+}
+
+// hold l across a read-modify-write of the file, against other processes
+void MediaProfiles::lockFile(QLockFile &l) const
+{
+    if (file.isEmpty()) {
+        return;
+    }
+    QDir().mkpath(QFileInfo(file).absolutePath());
+    //if that fails, the update goes ahead unlocked
+    l.lock();
+}
+
+void MediaProfiles::load()
+{
+    if (file.isEmpty()) {
+        return;
+    }
+    QFile f(file);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const QJsonObject root = QJsonDocument::fromJson(f.readAll()).object();
+    const QJsonObject all = root.value("profiles").toObject();
+    profiles.clear();
+    for (auto it = all.begin(); it != all.end(); ++it) {
+        const QJsonObject o = it.value().toObject();
+        Profile p;
+        p.checks = o.value("checks").toInt();
+        p.qbad = o.value("qbad").toDouble();
+        for (const QJsonValue &v : o.value("speeds").toArray()) {
+            const QJsonObject so = v.toObject();
+            SpeedRecord r;
+            r.kbps = so.value("kbps").toInt();
+            r.jobs = so.value("jobs").toInt();
+            r.failures = so.value("failures").toInt();
+            r.checks = so.value("checks").toInt();
+            r.qbad = so.value("qbad").toDouble();
+            p.speeds.push_back(r);
+        }
+        profiles.insert(it.key(), p);
+    }
+}
+
+void MediaProfiles::save() const
+{
+    if (file.isEmpty()) {
+        return;
+    }
+    QJsonObject all;
+    for (auto it = profiles.begin(); it != profiles.end(); ++it) {
+        QJsonArray speeds;
+        for (const SpeedRecord &r : it->speeds) {
+            speeds.append(QJsonObject {
+                { "kbps", r.kbps },
+                { "jobs", r.jobs },
+                { "failures", r.failures },
+                { "checks", r.checks },
+                { "qbad", r.qbad } });
+        }
+        all.insert(it.key(), QJsonObject {
+            { "checks", it->checks },
+            { "qbad", it->qbad },
+            { "speeds", speeds } });
+    }
+
+    QDir().mkpath(QFileInfo(file).absolutePath());
+    QSaveFile f(file);
+    if (!f.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    f.write(QJsonDocument(QJsonObject { { "version", 1 }, { "profiles", all } }).toJson());
+    f.commit();
+}
+
+// the record of kbps in p, added if there is none yet
+MediaProfiles::SpeedRecord *MediaProfiles::find(Profile &p, int kbps)
+{
+    for (SpeedRecord &r : p.speeds) {
+        if (r.kbps == kbps) {
+            return &r;
+        }
+    }
+    SpeedRecord r;
+    r.kbps = kbps;
+    p.speeds.push_back(r);
+    return &p.speeds.last();
+}
+
+}
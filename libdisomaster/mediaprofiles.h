@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef MEDIAPROFILES_H
+#define MEDIAPROFILES_H
+
+#include "disomaster.h"
+#include <QHash>
+#include <QMutex>
+
+class QLockFile;
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief What burning went like for a kind of media, kept on disk.
+ *
+ * A profile is keyed by media type, manufacturer and product id. It
+ * counts burns (and the failed ones) for each write speed used, and
+ * the bad portion found by checkmedia, for the speed the disc was
+ * burnt at when known. There is no database file unless a path is
+ * set. The file is JSON; each update reads it again and writes it back
+ * under a lock file (path + ".lock"), so that several processes can
+ * share it.
+ */
+class MediaProfiles
+{
+public:
+    struct SpeedRecord
+    {
+        int kbps = 0;
+        int jobs = 0;
+        int failures = 0;
+        int checks = 0;
+        double qbad = 0;    // summed over checks
+    };
+    struct Profile
+    {
+        QList<SpeedRecord> speeds;
+        //checks of discs burnt at an unknown speed
+        int checks = 0;
+        double qbad = 0;
+    };
+
+    MediaProfiles();
+
+    static MediaProfiles *instance();
+    static QString key(const DeviceProperty &p);
+
+    void setPath(const QString &path);
+    QString path() const;
+
+    Profile profile(const QString &key);
+    void recordWrite(const QString &key, int kbps, bool good);
+    void recordCheck(const QString &key, int kbps, double qbad);
+
+    static int choose(const Profile &p, MediaType media, QList<WriteSpeed> speeds);
+
+private:
+    void lockFile(QLockFile &l) const;
+    void load();
+    void save() const;
+    static SpeedRecord *find(Profile &p, int kbps);
+
+    mutable QMutex lock;
+    QString file;
+    QHash<QString, Profile> profiles;
+};
+
+}
+
+#endif // MEDIAPROFILES_H
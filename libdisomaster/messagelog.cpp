@@ -0,0 +1,213 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "messagelog.h"
+#include <QDateTime>
+#include <stdio.h>
+
+namespace DISOMasterNS {
+
+LogRing::LogRing(int capacity)
+    : capacity(qMax(capacity, 16)),
+      slots(new std::atomic<Item *>[size_t(this->capacity)]),
+      head(0),
+      ndropped(0),
+      tail(0)
+{
+    for (int i = 0; i < this->capacity; ++i) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+LogRing::~LogRing()
+{
+    for (int i = 0; i < capacity; ++i) {
+        delete slots[i].load(std::memory_order_relaxed);
+    }
+}
+
+/*!
+ * \brief Add an entry, dropping the oldest one if the ring is full.
+ *
+ * Must only be called from one thread at a time.
+ */
+void LogRing::append(LogMessage &&msg)
+{
+    const quint64 seq = head.load(std::memory_order_relaxed);
+    Item *item = new Item { seq, std::move(msg) };
+    Item *old = slots[seq % capacity].exchange(item, std::memory_order_acq_rel);
+    head.store(seq + 1, std::memory_order_release);
+    if (old) {
+        //nobody took it
+        delete old;
+        ndropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/*!
+ * \brief Take all entries out of the ring, oldest first. Nothing is copied.
+ */
+QList<LogMessage> LogRing::drain()
+{
+    std::vector<Item *> items;
+    {
+        std::lock_guard<std::mutex> locker(consumerlock);
+        const quint64 h = head.load(std::memory_order_acquire);
+        const quint64 from = h > quint64(capacity) ? qMax(tail, h - capacity) : tail;
+        items.reserve(size_t(h - from));
+        for (quint64 i = from; i < h; ++i) {
+            std::atomic<Item *> &slot = slots[i % capacity];
+            Item *item = slot.exchange(nullptr, std::memory_order_acq_rel);
+            if (!item) {
+                continue;
+            }
+            if (item->seq == i) {
+                items.push_back(item);
+                continue;
+            }
+            //the producer lapped us: the entry is for the next drain, unless
+            //a still newer one took the slot meanwhile and dropped it
+            Item *empty = nullptr;
+            if (!slot.compare_exchange_strong(empty, item, std::memory_order_acq_rel)) {
+                delete item;
+                ndropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        tail = h;
+    }
+
+    QList<LogMessage> ret;
+    ret.reserve(int(items.size()));
+    for (Item *item : items) {
+        ret.push_back(std::move(item->msg));
+        delete item;
+    }
+    return ret;
+}
+
+MessageLog::MessageLog(int capacity)
+    : ring(capacity),
+      categories(LogMessage::AllCategories),
+      minseverity(LogMessage::Debug),
+      echo(false),
+      echostop(false)
+{
+}
+
+MessageLog::~MessageLog()
+{
+    if (echothread.joinable()) {
+        {
+            std::lock_guard<std::mutex> locker(echolock);
+            echostop = true;
+        }
+        echowake.notify_one();
+        echothread.join();
+    }
+}
+
+/*!
+ * \brief Build a log entry from a message of xorriso.
+ * \param channel 0 for a result, 1 for an info message
+ *
+ * Info messages look like "xorriso : SEVERITY : text".
+ */
+LogMessage MessageLog::parse(int channel, const QString &text)
+{
+    static const struct {
+        const char *name;
+        LogMessage::Severity severity;
+    } severities[] = {
+        { "DEBUG", LogMessage::Debug },
+        { "UPDATE", LogMessage::Update },
+        { "NOTE", LogMessage::Note },
+        { "HINT", LogMessage::Hint },
+        { "WARNING", LogMessage::Warning },
+        { "SORRY", LogMessage::Sorry },
+        { "FAILURE", LogMessage::Failure },
+        { "FATAL", LogMessage::Fatal },
+    };
+
+    LogMessage ret;
+    ret.timestamp = QDateTime::currentMSecsSinceEpoch();
+    ret.text = text;
+    ret.category = channel ? LogMessage::InfoCategory : LogMessage::ResultCategory;
+    ret.severity = LogMessage::Note;
+    if (!channel) {
+        return ret;
+    }
+
+    const int from = text.indexOf(QLatin1String(" : "));
+    const int to = from < 0 ? -1 : text.indexOf(QLatin1String(" : "), from + 3);
+    if (to < 0) {
+        return ret;
+    }
+    const QStringRef name = text.midRef(from + 3, to - from - 3);
+    for (const auto &s : severities) {
+        if (name == QLatin1String(s.name)) {
+            ret.severity = s.severity;
+            break;
+        }
+    }
+    if (ret.severity == LogMessage::Update) {
+        ret.category = LogMessage::ProgressCategory;
+    }
+    return ret;
+}
+
+void MessageLog::append(LogMessage &&msg)
+{
+    if (!(categories.load(std::memory_order_relaxed) & msg.category)
+            || msg.severity < minseverity.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (echo.load(std::memory_order_acquire)) {
+        LogMessage copy = msg;
+        echoring->append(std::move(copy));
+        //a missed wake-up only delays the output to the next poll
+        echowake.notify_one();
+    }
+    ring.append(std::move(msg));
+}
+
+/*!
+ * \brief Only keep messages of the given categories and at least the given severity.
+ */
+void MessageLog::setFilter(LogMessage::Categories categories, LogMessage::Severity minseverity)
+{
+    this->categories = int(categories);
+    this->minseverity = minseverity;
+}
+
+/*!
+ * \brief Echo messages to stderr. The writes happen on a thread of their own.
+ */
+void MessageLog::setEcho(bool on)
+{
+    if (on && !echothread.joinable()) {
+        echoring.reset(new LogRing(1024));
+        echothread = std::thread([this] { echoLoop(); });
+    }
+    echo.store(on && echoring, std::memory_order_release);
+}
+
+void MessageLog::echoLoop()
+{
+    std::unique_lock<std::mutex> locker(echolock);
+    for (;;) {
+        echowake.wait_for(locker, std::chrono::milliseconds(100));
+        const bool stop = echostop;
+        locker.unlock();
+        for (const LogMessage &m : echoring->drain()) {
+            fprintf(stderr, "msg from xorriso (%s) : %s\n",
+                    m.category == LogMessage::ResultCategory ? "result" : " info ", m.text.toUtf8().constData());
+        }
+        locker.lock();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+}
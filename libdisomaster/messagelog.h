@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef MESSAGELOG_H
+#define MESSAGELOG_H
+
+#include "disomaster.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Fixed-capacity ring of log messages.
+ *
+ * The single producer never waits: append() swaps its entry into a slot,
+ * dropping the oldest entry once the ring is full. Consumers take
+ * entries out of the slots the same way, so an entry is owned by exactly
+ * one side at any time.
+ */
+class LogRing
+{
+public:
+    explicit LogRing(int capacity);
+    ~LogRing();
+
+    void append(LogMessage &&msg);
+    QList<LogMessage> drain();
+    quint64 dropped() const { return ndropped; }
+
+private:
+    Q_DISABLE_COPY(LogRing)
+    struct Item
+    {
+        quint64 seq;
+        LogMessage msg;
+    };
+
+    const int capacity;
+    std::unique_ptr<std::atomic<Item *>[]> slots;
+    std::atomic<quint64> head;      // sequence number of the next entry
+    std::atomic<quint64> ndropped;
+    std::mutex consumerlock;        // consumers only wait for each other
+    quint64 tail;
+};
+
+/*!
+ * \brief Messages from xorriso: a filtered ring, echoed to stderr from
+ * a thread of its own if asked to.
+ */
+class MessageLog
+{
+public:
+    explicit MessageLog(int capacity = 4096);
+    ~MessageLog();
+
+    static LogMessage parse(int channel, const QString &text);
+
+    void append(LogMessage &&msg);
+    QList<LogMessage> drain() { return ring.drain(); }
+    void discard() { ring.drain(); }
+    quint64 dropped() const { return ring.dropped(); }
+
+    void setFilter(LogMessage::Categories categories, LogMessage::Severity minseverity);
+    void setEcho(bool on);
+
+private:
+    void echoLoop();
+
+    LogRing ring;
+    std::atomic<int> categories;
+    std::atomic<int> minseverity;
+
+    std::atomic<bool> echo;
+    std::unique_ptr<LogRing> echoring;
+    std::thread echothread;
+    std::mutex echolock;
+    std::condition_variable echowake;
+    bool echostop;
+};
+
+}
+
+#endif // MESSAGELOG_H
@@ -0,0 +1,345 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "spanplanner.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QHash>
+#include <algorithm>
+
+namespace DISOMasterNS {
+
+const char *SpanPlanner::ManifestPath = "/.disomaster-span";
+
+//system area, volume descriptors, path tables, session MD5 tags and the 300k padding of xorriso
+static const qint64 FixedBlocks = 256;
+//extent and records of a directory
+static const qint64 DirBytes = 2048 + 256;
+
+static qint64 roundUp(qint64 bytes)
+{
+    return (bytes + 2047) / 2048 * 2048;
+}
+
+static QString fileName(const QString &path)
+{
+    return path.mid(path.lastIndexOf('/') + 1);
+}
+
+// estimated bytes of a file on the disc: data, directory records and its line in the manifest
+static qint64 fileCost(const QString &target, qint64 length)
+{
+    return roundUp(length) + SpanPlanner::entryBytes(fileName(target)) + 48 + 3 * target.toUtf8().size();
+}
+
+namespace {
+// room left in each bin, with the leftmost bin that has enough found in log(bins)
+class Bins
+{
+public:
+    Bins(int n, qint64 room)
+        : leaves(1)
+    {
+        while (leaves < n) {
+            leaves <<= 1;
+        }
+        tree.fill(room, 2 * leaves);
+    }
+
+    int firstFit(qint64 size) const
+    {
+        if (tree[1] < size) {
+            return -1;
+        }
+        int i = 1;
+        while (i < leaves) {
+            i = tree[2 * i] >= size ? 2 * i : 2 * i + 1;
+        }
+        return i - leaves;
+    }
+
+    void take(int bin, qint64 size)
+    {
+        int i = bin + leaves;
+        tree[i] -= size;
+        for (i >>= 1; i >= 1; i >>= 1) {
+            tree[i] = qMax(tree[2 * i], tree[2 * i + 1]);
+        }
+    }
+
+private:
+    int leaves;
+    QVector<qint64> tree;
+};
+}
+
+/*!
+ * \brief Estimated bytes of the directory records of a file named name:
+ * ISO 9660 with Rock Ridge fields, and Joliet.
+ */
+qint64 SpanPlanner::entryBytes(const QString &name)
+{
+    return 228 + 4 * name.toUtf8().size();
+}
+
+/*!
+ * \brief Spread the staged entries over discs of capacity bytes.
+ * \param entries staged entries (local path, on-disc path), directories are walked.
+ * \param measure exact size of a disc in blocks; without it, the
+ * estimate is used and blocks of each disc holds the estimate.
+ * \return the discs, or an empty list if nothing is staged, if a file
+ * is bigger than a disc and may not be split, or if measuring failed.
+ */
+QList<DiscPlan> SpanPlanner::plan(const QList<StagingTree::Entry> &entries, qint64 capacity,
+                                  SpanOptions opts, const Measure &measure)
+{
+    const qint64 capblocks = capacity / 2048;
+    const qint64 budget = (capblocks - FixedBlocks) * 2048;
+    QVector<File> staged;
+    collect(entries, staged);
+    if (budget <= 0 || staged.isEmpty()) {
+        return QList<DiscPlan>();
+    }
+
+    QVector<File> files;
+    files.reserve(staged.size());
+    for (File &f : staged) {
+        f.cost = fileCost(f.target, f.length);
+        if (f.cost <= budget) {
+            files.push_back(f);
+            continue;
+        }
+        if (!opts.testFlag(SplitLargeFiles)) {
+            return QList<DiscPlan>();
+        }
+        const qint64 partsize = (budget - fileCost(f.target + ".part000000", 0) - DirBytes) / 2048 * 2048;
+        if (partsize <= 0) {
+            return QList<DiscPlan>();
+        }
+        const int parts = int((f.size + partsize - 1) / partsize);
+        for (int i = 0; i < parts; ++i) {
+            File p = f;
+            p.target = f.target + ".part" + QString::number(i + 1);
+            p.offset = i * partsize;
+            p.length = qMin(partsize, f.size - p.offset);
+            p.part = i + 1;
+            p.parts = parts;
+            p.cost = fileCost(p.target, p.length);
+            files.push_back(p);
+        }
+    }
+
+    //directories on the disc, with the estimated size of their subtrees
+    QHash<QString, int> ids;
+    QVector<Dir> dirs;
+    for (File &f : files) {
+        const int slash = f.target.lastIndexOf('/');
+        f.dir = dirId(slash > 0 ? f.target.left(slash) : QString("/"), ids, dirs);
+    }
+    for (int d = 0; d < dirs.size(); ++d) {
+        for (int a = dirs[d].parent; a >= 0; a = dirs[a].parent) {
+            dirs[a].total += DirBytes;
+        }
+    }
+    for (const File &f : files) {
+        for (int d = f.dir; d >= 0; d = dirs[d].parent) {
+            dirs[d].total += f.cost;
+        }
+    }
+
+    //items to pack: whole subtrees where they fit, single files otherwise
+    QVector<qint64> itemcost;
+    QVector<int> itemhead;
+    QVector<int> nextfile(files.size(), -1);
+    QHash<int, int> groupitems;
+    for (int i = 0; i < files.size(); ++i) {
+        const int group = opts.testFlag(KeepDirectories) ? groupOf(files[i].dir, dirs, budget) : -1;
+        int item = group >= 0 ? groupitems.value(group, -1) : -1;
+        if (item < 0) {
+            item = itemcost.size();
+            itemcost.push_back(group >= 0 ? dirs[group].total : files[i].cost);
+            itemhead.push_back(-1);
+            if (group >= 0) {
+                groupitems.insert(group, item);
+            }
+        }
+        nextfile[i] = itemhead[item];
+        itemhead[item] = i;
+    }
+
+    //first fit decreasing
+    QVector<int> order(itemcost.size());
+    for (int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&itemcost](int a, int b) {
+        return itemcost[a] > itemcost[b];
+    });
+    Bins bins(itemcost.size(), budget);
+    QVector<int> binof(itemcost.size());
+    int nbins = 0;
+    for (int item : order) {
+        //every item fits on an empty disc
+        const int bin = bins.firstFit(itemcost[item]);
+        bins.take(bin, itemcost[item]);
+        binof[item] = bin;
+        nbins = qMax(nbins, bin + 1);
+    }
+
+    QList<DiscPlan> discs;
+    QVector<qint64> estimate(nbins, 0);
+    for (int i = 0; i < nbins; ++i) {
+        discs.push_back(DiscPlan());
+    }
+    for (int item = 0; item < itemcost.size(); ++item) {
+        DiscPlan &disc = discs[binof[item]];
+        for (int i = itemhead[item]; i >= 0; i = nextfile[i]) {
+            const File &f = files[i];
+            SpanFile sf;
+            sf.source = f.source;
+            sf.target = f.target;
+            sf.offset = f.offset;
+            sf.length = f.length;
+            sf.part = f.part;
+            sf.parts = f.parts;
+            disc.files.push_back(sf);
+            disc.databytes += f.length;
+        }
+        estimate[binof[item]] += itemcost[item];
+    }
+
+    //measure each disc, moving what does not fit on to the next one
+    const QUuid set = QUuid::createUuid();
+    for (int i = 0; i < discs.size(); ++i) {
+        std::sort(discs[i].files.begin(), discs[i].files.end(), [](const SpanFile &a, const SpanFile &b) {
+            return StagingTree::pathLessThan(a.target, b.target);
+        });
+        discs[i].disc = i + 1;
+        discs[i].manifest = manifest(discs[i], set);
+        if (!measure) {
+            discs[i].blocks = FixedBlocks + (estimate[i] + 2047) / 2048;
+            continue;
+        }
+        for (;;) {
+            const qint64 blocks = measure(discs[i]);
+            if (blocks < 0) {
+                return QList<DiscPlan>();
+            }
+            discs[i].blocks = blocks;
+            if (blocks <= capblocks) {
+                break;
+            }
+            if (discs[i].files.size() <= 1) {
+                return QList<DiscPlan>();
+            }
+            if (i + 1 == discs.size()) {
+                discs.push_back(DiscPlan());
+            }
+            DiscPlan &disc = discs[i];
+            DiscPlan &next = discs[i + 1];
+            qint64 excess = (blocks - capblocks) * 2048;
+            QList<SpanFile> moved;
+            while (excess > 0 && disc.files.size() > 1) {
+                const SpanFile f = disc.files.takeLast();
+                excess -= fileCost(f.target, f.length);
+                disc.databytes -= f.length;
+                next.databytes += f.length;
+                moved.prepend(f);
+            }
+            next.files = moved + next.files;
+            disc.manifest = manifest(disc, set);
+        }
+    }
+    return discs;
+}
+
+/*!
+ * \brief The manifest of a disc: set id, disc number, and for each
+ * file its part / parts, offset, length and percent-encoded path on
+ * the disc, tab-separated.
+ */
+QByteArray SpanPlanner::manifest(const DiscPlan &plan, const QUuid &set)
+{
+    QByteArray out = "# disomaster span manifest\n";
+    out += "set " + set.toByteArray() + '\n';
+    out += "disc " + QByteArray::number(plan.disc) + '\n';
+    for (const SpanFile &f : plan.files) {
+        out += QByteArray::number(f.part) + '/' + QByteArray::number(f.parts) + '\t'
+                + QByteArray::number(f.offset) + '\t' + QByteArray::number(f.length) + '\t'
+                + f.target.toUtf8().toPercentEncoding("/") + '\n';
+    }
+    return out;
+}
+
+// the files under the staged entries, and the empty directories
+void SpanPlanner::collect(const QList<StagingTree::Entry> &entries, QVector<File> &files)
+{
+    const auto add = [&files](const QString &source, const QString &target, qint64 size) {
+        files.push_back({ source, QDir::cleanPath(target), size, 0, size, 0, 0, -1, 0 });
+    };
+    const QDir::Filters filter = QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot;
+    for (const StagingTree::Entry &e : entries) {
+        const QFileInfo fi(e.first);
+        if (fi.isSymLink() || (fi.exists() && !fi.isDir())) {
+            add(e.first, e.second, fi.isSymLink() ? 0 : fi.size());
+            continue;
+        }
+        if (!fi.isDir()) {
+            continue;
+        }
+        const QString root = e.first.endsWith('/') ? e.first : e.first + '/';
+        const QString target = e.second.endsWith('/') ? e.second : e.second + '/';
+        bool empty = true;
+        QDirIterator it(e.first, filter, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const QString path = it.next();
+            const QFileInfo &info = it.fileInfo();
+            empty = false;
+            if (info.isDir() && !info.isSymLink()) {
+                if (QDir(path).isEmpty(filter)) {
+                    add(path, target + path.mid(root.size()), 0);
+                }
+                continue;
+            }
+            add(path, target + path.mid(root.size()), info.isSymLink() ? 0 : info.size());
+        }
+        if (empty) {
+            add(e.first, e.second, 0);
+        }
+    }
+}
+
+int SpanPlanner::dirId(const QString &path, QHash<QString, int> &ids, QVector<Dir> &dirs)
+{
+    const auto it = ids.constFind(path);
+    if (it != ids.constEnd()) {
+        return *it;
+    }
+    int parent = -1;
+    if (path != "/") {
+        const int slash = path.lastIndexOf('/');
+        parent = dirId(slash > 0 ? path.left(slash) : QString("/"), ids, dirs);
+    }
+    dirs.push_back({ parent, DirBytes, -2 });
+    ids.insert(path, dirs.size() - 1);
+    return dirs.size() - 1;
+}
+
+// the outermost directory around dir whose subtree fits on a disc
+int SpanPlanner::groupOf(int dir, QVector<Dir> &dirs, qint64 budget)
+{
+    if (dirs[dir].group != -2) {
+        return dirs[dir].group;
+    }
+    int group = -1;
+    if (dirs[dir].total <= budget) {
+        const int outer = dirs[dir].parent >= 0 ? groupOf(dirs[dir].parent, dirs, budget) : -1;
+        group = outer >= 0 ? outer : dir;
+    }
+    dirs[dir].group = group;
+    return group;
+}
+
+}
@@ -0,0 +1,66 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef SPANPLANNER_H
+#define SPANPLANNER_H
+
+#include "disomaster.h"
+#include "stagingtree.h"
+#include <QHash>
+#include <QUuid>
+#include <QVector>
+#include <functional>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Spreads staged files over a set of discs.
+ *
+ * Files are packed first-fit-decreasing on an estimate of their size
+ * on the disc: data blocks plus ISO 9660, Rock Ridge and Joliet
+ * directory records. With KeepDirectories, the largest directory
+ * subtree that fits on a disc is packed as one item. Each disc is then
+ * measured exactly, if a measure is given, and files from the end of
+ * an overfull disc move on to the next one until every disc fits.
+ */
+class SpanPlanner
+{
+public:
+    typedef std::function<qint64(const DiscPlan &)> Measure;   // image blocks of a disc, -1 on error
+
+    static const char *ManifestPath;
+
+    static QList<DiscPlan> plan(const QList<StagingTree::Entry> &entries, qint64 capacity,
+                                SpanOptions opts, const Measure &measure = Measure());
+    static QByteArray manifest(const DiscPlan &plan, const QUuid &set);
+    static qint64 entryBytes(const QString &name);
+
+private:
+    struct File
+    {
+        QString source;
+        QString target;
+        qint64 size;        // of the local file
+        qint64 offset;
+        qint64 length;
+        int part;
+        int parts;
+        int dir;            // parent directory on the disc
+        qint64 cost;        // estimated bytes on the disc
+    };
+    struct Dir
+    {
+        int parent;
+        qint64 total;       // estimated bytes of the subtree
+        int group;          // dir whose subtree is packed as one item, -1 if none, -2 if not known yet
+    };
+
+    static void collect(const QList<StagingTree::Entry> &entries, QVector<File> &files);
+    static int dirId(const QString &path, QHash<QString, int> &ids, QVector<Dir> &dirs);
+    static int groupOf(int dir, QVector<Dir> &dirs, qint64 budget);
+};
+
+}
+
+#endif // SPANPLANNER_H
@@ -0,0 +1,289 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "stagingtree.h"
+#include <algorithm>
+
+namespace DISOMasterNS {
+
+/*
+ * "/data//sub/" -> { "", "data", "sub" }
+ * The leading empty component marks an absolute path.
+ */
+static QVector<QStringRef> splitPath(const QString &path)
+{
+    QVector<QStringRef> ret = path.splitRef('/');
+    int j = 0;
+    for (int i = 0; i < ret.size(); ++i) {
+        if (i == 0 || !ret[i].isEmpty()) {
+            ret[j++] = ret[i];
+        }
+    }
+    ret.resize(j);
+    return ret;
+}
+
+// whether the components of path, joined again, give path back ("file:///x" does not)
+static bool isPlainPath(const QString &path)
+{
+    return path == "/" || (!path.isEmpty() && !path.endsWith('/') && !path.contains("//"));
+}
+
+static QString joinTarget(const QString &parent, const QString &name)
+{
+    return parent.endsWith('/') ? parent + name : parent + '/' + name;
+}
+
+StagingTree::StagingTree()
+    : count(0)
+{
+    nodes.resize(1);
+}
+
+/*!
+ * \brief Order paths the way the tree iterates them ('/' sorts first).
+ *
+ * Inserting entries sorted this way only ever appends children.
+ */
+bool StagingTree::pathLessThan(const QString &a, const QString &b)
+{
+    const int n = qMin(a.size(), b.size());
+    for (int i = 0; i < n; ++i) {
+        if (a[i] != b[i]) {
+            if (a[i] == '/') {
+                return true;
+            }
+            if (b[i] == '/') {
+                return false;
+            }
+            return a[i] < b[i];
+        }
+    }
+    return a.size() < b.size();
+}
+
+/*!
+ * \brief Stage source as target, replacing its previous target if any.
+ */
+void StagingTree::insert(const QString &source, const QString &target)
+{
+    int node = 0;
+    for (const QStringRef &comp : splitPath(source)) {
+        const int idx = childIndex(node, comp.toString());
+        const QVector<int> &children = nodes[node].children;
+        if (idx < children.size() && nodes[children[idx]].name == comp) {
+            node = children[idx];
+        } else {
+            const int child = allocNode(comp.toString(), node);
+            nodes[node].children.insert(idx, child);
+            node = child;
+        }
+    }
+    if (nodes[node].target.isNull()) {
+        ++count;
+    }
+    nodes[node].target = target.isNull() ? QString("") : target;
+    nodes[node].source = isPlainPath(source) ? QString() : source;
+}
+
+/*!
+ * \brief Stage a batch of entries.
+ *
+ * The batch is sorted first so that large directories are filled
+ * by appending instead of inserting in the middle.
+ */
+void StagingTree::insert(QVector<Entry> entries)
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return pathLessThan(a.first, b.first);
+    });
+    for (const Entry &e : entries) {
+        insert(e.first, e.second);
+    }
+}
+
+/*!
+ * \brief Unstage source itself. Anything staged below it is kept.
+ * \return true if source was staged.
+ */
+bool StagingTree::remove(const QString &source)
+{
+    const int node = find(source);
+    if (node <= 0 || nodes[node].target.isNull()) {
+        return false;
+    }
+    nodes[node].target = QString();
+    nodes[node].source = QString();
+    --count;
+    prune(node);
+    return true;
+}
+
+/*!
+ * \brief Unstage source and everything staged below it.
+ * \return the number of entries removed.
+ */
+int StagingTree::removeTree(const QString &source)
+{
+    const int node = find(source);
+    if (node <= 0) {
+        return 0;
+    }
+    const int before = count;
+    const int parent = nodes[node].parent;
+    QVector<int> &siblings = nodes[parent].children;
+    siblings.remove(childIndex(parent, nodes[node].name));
+    releaseTree(node);
+    prune(parent);
+    return before - count;
+}
+
+void StagingTree::clear()
+{
+    nodes.clear();
+    nodes.resize(1);
+    freenodes.clear();
+    count = 0;
+}
+
+/*!
+ * \brief On-disc target of source, or a null string if it is not staged.
+ */
+QString StagingTree::target(const QString &source) const
+{
+    const int node = find(source);
+    return node > 0 ? nodes[node].target : QString();
+}
+
+/*!
+ * \brief All staged entries, in deterministic (path) order.
+ * \param skipCovered leave out entries that are already covered by a
+ * staged ancestor directory, i.e. whose target is exactly where the
+ * ancestor would put them anyway.
+ */
+QList<StagingTree::Entry> StagingTree::entries(bool skipCovered) const
+{
+    QList<Entry> ret;
+    ret.reserve(count);
+    for (int child : nodes[0].children) {
+        collect(child, nodes[child].name, QString(), skipCovered, ret);
+    }
+    return ret;
+}
+
+/*!
+ * \brief Approximate heap memory held by the tree, in bytes.
+ */
+quint64 StagingTree::memoryUsage() const
+{
+    const quint64 header = sizeof(QArrayData);
+    quint64 ret = sizeof(*this) + nodes.capacity() * sizeof(Node) + freenodes.capacity() * sizeof(int);
+    for (const Node &n : nodes) {
+        if (n.name.capacity()) {
+            ret += header + (n.name.capacity() + 1) * sizeof(QChar);
+        }
+        if (n.target.capacity()) {
+            ret += header + (n.target.capacity() + 1) * sizeof(QChar);
+        }
+        if (n.source.capacity()) {
+            ret += header + (n.source.capacity() + 1) * sizeof(QChar);
+        }
+        if (n.children.capacity()) {
+            ret += header + n.children.capacity() * sizeof(int);
+        }
+    }
+    return ret;
+}
+
+int StagingTree::find(const QString &source) const
+{
+    int node = 0;
+    for (const QStringRef &comp : splitPath(source)) {
+        const int idx = childIndex(node, comp.toString());
+        const QVector<int> &children = nodes[node].children;
+        if (idx >= children.size() || nodes[children[idx]].name != comp) {
+            return -1;
+        }
+        node = children[idx];
+    }
+    return node;
+}
+
+// position of name in the children of node (lower bound)
+int StagingTree::childIndex(int node, const QString &name) const
+{
+    const QVector<int> &children = nodes[node].children;
+    int lo = 0;
+    int hi = children.size();
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (nodes[children[mid]].name < name) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int StagingTree::allocNode(const QString &name, int parent)
+{
+    int node;
+    if (freenodes.isEmpty()) {
+        node = nodes.size();
+        nodes.append(Node());
+    } else {
+        node = freenodes.takeLast();
+    }
+    nodes[node].name = name;
+    nodes[node].parent = parent;
+    return node;
+}
+
+// free node and its descendants. The caller unlinks it from its parent.
+void StagingTree::releaseTree(int node)
+{
+    QVector<int> pending { node };
+    while (!pending.isEmpty()) {
+        const int i = pending.takeLast();
+        pending += nodes[i].children;
+        if (!nodes[i].target.isNull()) {
+            --count;
+        }
+        nodes[i] = Node();
+        freenodes.push_back(i);
+    }
+}
+
+// drop node and its ancestors as long as they lead nowhere
+void StagingTree::prune(int node)
+{
+    while (node > 0 && nodes[node].target.isNull() && nodes[node].children.isEmpty()) {
+        const int parent = nodes[node].parent;
+        nodes[parent].children.remove(childIndex(parent, nodes[node].name));
+        nodes[node] = Node();
+        freenodes.push_back(node);
+        node = parent;
+    }
+}
+
+void StagingTree::collect(int node, const QString &path, const QString &implied, bool skipCovered, QList<Entry> &out) const
+{
+    const Node &n = nodes[node];
+    QString effective = implied;
+    if (!n.target.isNull()) {
+        if (!(skipCovered && !implied.isNull() && n.target == implied)) {
+            out.push_back(Entry(!n.source.isNull() ? n.source : path.isEmpty() ? QString("/") : path, n.target));
+        }
+        effective = n.target;
+    }
+    for (int child : n.children) {
+        const QString &name = nodes[child].name;
+        collect(child, path + '/' + name,
+                effective.isNull() ? QString() : joinTarget(effective, name),
+                skipCovered, out);
+    }
+}
+
+}
@@ -0,0 +1,67 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef STAGINGTREE_H
+#define STAGINGTREE_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Staged files, stored as a tree of local path components.
+ *
+ * Each staged local path carries its on-disc target path. Children
+ * are kept sorted, so iteration order does not depend on the order
+ * files were staged in.
+ */
+class StagingTree
+{
+public:
+    typedef QPair<QString, QString> Entry; // local path, on-disc path
+
+    StagingTree();
+
+    void insert(const QString &source, const QString &target);
+    void insert(QVector<Entry> entries);
+    bool remove(const QString &source);
+    int removeTree(const QString &source);
+    void clear();
+
+    int size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    QString target(const QString &source) const;
+    QList<Entry> entries(bool skipCovered = false) const;
+    quint64 memoryUsage() const;
+
+    static bool pathLessThan(const QString &a, const QString &b);
+
+private:
+    struct Node
+    {
+        QString name;
+        QString target;         // null unless this path is staged itself
+        QString source;         // the path as staged, if the components do not spell it
+        int parent = -1;
+        QVector<int> children;  // sorted by name
+    };
+
+    QVector<Node> nodes;        // nodes[0] is the root
+    QVector<int> freenodes;
+    int count;
+
+    int find(const QString &source) const;
+    int childIndex(int node, const QString &name) const;
+    int allocNode(const QString &name, int parent);
+    void releaseTree(int node);
+    void prune(int node);
+    void collect(int node, const QString &path, const QString &implied, bool skipCovered, QList<Entry> &out) const;
+};
+
+}
+
+#endif // STAGINGTREE_H
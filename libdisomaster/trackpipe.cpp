@@ -0,0 +1,104 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "trackpipe.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+namespace DISOMasterNS {
+
+TrackPipe::TrackPipe()
+    : rfd(-1),
+      wfd(-1)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return;
+    }
+    rfd = fds[0];
+    wfd = fds[1];
+    fcntl(wfd, F_SETPIPE_SZ, 1 << 20);
+    fcntl(wfd, F_SETFL, fcntl(wfd, F_GETFL) | O_NONBLOCK);
+}
+
+TrackPipe::~TrackPipe()
+{
+    closeWrite();
+    if (rfd >= 0) {
+        ::close(rfd);
+    }
+}
+
+bool TrackPipe::isValid() const
+{
+    return rfd >= 0;
+}
+
+/*!
+ * \brief The track to pass to writeISO().
+ */
+QUrl TrackPipe::track() const
+{
+    return QUrl::fromLocalFile(QString("/dev/fd/%1").arg(rfd));
+}
+
+/*!
+ * \brief Write all of data, giving up once the job has ended (the drive stopped reading).
+ */
+bool TrackPipe::write(const char *data, qint64 len, const QFuture<JobResult> &job)
+{
+    if (wfd < 0) {
+        return false;
+    }
+
+    //we want EPIPE from write() rather than the signal
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+
+    bool ok = true;
+    while (len > 0) {
+        const ssize_t n = ::write(wfd, data, size_t(len));
+        if (n > 0) {
+            data += n;
+            len -= n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if ((n < 0 && errno != EAGAIN) || job.isFinished()) {
+            ok = false;
+            break;
+        }
+        struct pollfd pfd = { wfd, POLLOUT, 0 };
+        poll(&pfd, 1, 100);
+    }
+
+    //swallow the SIGPIPE we may have caused, it is pending on this thread
+    if (!ok && !sigismember(&old, SIGPIPE)) {
+        const struct timespec zero = { 0, 0 };
+        while (sigtimedwait(&set, nullptr, &zero) > 0) {
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    return ok;
+}
+
+/*!
+ * \brief Signal the end of the track.
+ */
+void TrackPipe::closeWrite()
+{
+    if (wfd >= 0) {
+        ::close(wfd);
+        wfd = -1;
+    }
+}
+
+}
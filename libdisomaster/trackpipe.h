@@ -0,0 +1,38 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef TRACKPIPE_H
+#define TRACKPIPE_H
+
+#include "disomaster.h"
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief A pipe libburn reads a track from, as if it were a file.
+ *
+ * The read end is handed to writeISO() as /dev/fd/N, the write end is
+ * fed by us. A drive that quits early closes its end: write() then
+ * fails instead of raising SIGPIPE.
+ */
+class TrackPipe
+{
+public:
+    TrackPipe();
+    ~TrackPipe();
+
+    bool isValid() const;
+    QUrl track() const;
+    bool write(const char *data, qint64 len, const QFuture<JobResult> &job);
+    void closeWrite();
+
+private:
+    Q_DISABLE_COPY(TrackPipe)
+    int rfd;
+    int wfd;
+};
+
+}
+
+#endif // TRACKPIPE_H
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "watcherchannel.h"
+
+namespace DISOMasterNS {
+
+/*
+ * "12.3x" -> 123. The speed always carries exactly one decimal,
+ * so the tenths give the very same string back.
+ */
+static int speedTenths(const QString &speed)
+{
+    if (speed.size() < 4) {
+        return -1;
+    }
+    int ret = 0;
+    for (int i = 0; i < speed.size() - 1; ++i) {
+        if (speed[i].isDigit()) {
+            ret = ret * 10 + speed[i].digitValue();
+        }
+    }
+    return ret;
+}
+
+WatcherChannel::WatcherChannel()
+    : curspeed(-1),
+      curfifo(-1),
+      curbuffer(-1),
+      minfifo(-1)
+{
+}
+
+/*!
+ * \brief Publish what a message from xorriso tells.
+ *
+ * Must only be called from the message watcher thread.
+ */
+void WatcherChannel::post(const XorrisoMessage &m)
+{
+    if (m.type == XorrisoMessage::PhaseChange) {
+        return;
+    }
+    curspeed.store(speedTenths(m.speed), std::memory_order_relaxed);
+    if (m.fifo >= 0) {
+        curfifo.store(m.fifo, std::memory_order_relaxed);
+        curbuffer.store(m.buffer, std::memory_order_relaxed);
+        int low = minfifo.load(std::memory_order_relaxed);
+        while ((low < 0 || m.fifo < low)
+               && !minfifo.compare_exchange_weak(low, m.fifo, std::memory_order_relaxed)) {
+        }
+    }
+    if (m.type == XorrisoMessage::MD5Mismatch) {
+        QString path = m.path;
+        mismatches.push(std::move(path));
+    }
+}
+
+/*!
+ * \brief The current speed (e.g. "4.0x"), empty if the last message carried none.
+ */
+QString WatcherChannel::speed() const
+{
+    const int s = curspeed.load(std::memory_order_relaxed);
+    if (s < 0) {
+        return QString();
+    }
+    return QString::number(s / 10) + '.' + QString::number(s % 10) + 'x';
+}
+
+/*!
+ * \brief Forget the mismatches and state of the last job.
+ *
+ * Must only be called from the thread running the job.
+ */
+void WatcherChannel::reset()
+{
+    QString path;
+    while (mismatches.pop(path)) {
+    }
+    curspeed.store(-1, std::memory_order_relaxed);
+    curfifo.store(-1, std::memory_order_relaxed);
+    curbuffer.store(-1, std::memory_order_relaxed);
+    minfifo.store(-1, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,104 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef WATCHERCHANNEL_H
+#define WATCHERCHANNEL_H
+
+#include "xorrisomessage.h"
+#include <atomic>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Unbounded single producer, single consumer queue.
+ *
+ * Neither side ever waits for the other: the producer links a new
+ * node behind the last one, the consumer moves past the first one.
+ * The first node is always a spent one, so the two sides never touch
+ * the same node except through its next pointer.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+    SpscQueue()
+        : head(new Node), tail(head) {}
+    ~SpscQueue()
+    {
+        while (head) {
+            Node *next = head->next.load(std::memory_order_relaxed);
+            delete head;
+            head = next;
+        }
+    }
+
+    void push(T &&value)
+    {
+        Node *n = new Node;
+        n->value = std::move(value);
+        tail->next.store(n, std::memory_order_release);
+        tail = n;
+    }
+
+    bool pop(T &value)
+    {
+        Node *next = head->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        value = std::move(next->value);
+        delete head;
+        head = next;
+        return true;
+    }
+
+private:
+    Q_DISABLE_COPY(SpscQueue)
+    struct Node
+    {
+        std::atomic<Node *> next { nullptr };
+        T value;
+    };
+    Node *head;     //consumer only
+    Node *tail;     //producer only
+};
+
+/*!
+ * \brief What the xorriso message watcher hands over to everyone else.
+ *
+ * The watcher is the only writer. State anyone may read at any time
+ * (the current speed and buffer fill, the lowest FIFO fill of the job)
+ * is published through atomics; only the MD5 mismatches, which the
+ * running job has to collect one by one, are queued for its thread.
+ */
+class WatcherChannel
+{
+public:
+    WatcherChannel();
+
+    //message watcher thread
+    void post(const XorrisoMessage &m);
+
+    //any thread
+    QString speed() const;
+    int fifo() const { return curfifo.load(std::memory_order_relaxed); }
+    int buffer() const { return curbuffer.load(std::memory_order_relaxed); }
+    int minFifo() const { return minfifo.load(std::memory_order_relaxed); }
+
+    //the thread running the job
+    bool takeMismatch(QString &path) { return mismatches.pop(path); }
+    void reset();
+
+private:
+    Q_DISABLE_COPY(WatcherChannel)
+    std::atomic<int> curspeed;      //tenths of the base speed, -1 if none
+    std::atomic<int> curfifo;
+    std::atomic<int> curbuffer;
+    std::atomic<int> minfifo;       //-1 if none yet
+    SpscQueue<QString> mismatches;
+};
+
+}
+
+#endif // WATCHERCHANNEL_H
@@ -0,0 +1,201 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "xorrisomessage.h"
+#include <QHash>
+#include <QRegularExpression>
+
+namespace DISOMasterNS {
+
+/*
+ * Equivalent of matching "([0-9]*\.[0-9]x)[bBcCdD.]", without a regex.
+ * The leftmost 'x' that fits the pattern is also the leftmost match.
+ */
+static QString scanSpeed(const QString &msg)
+{
+    const int n = msg.length();
+    for (int i = 2; i < n - 1; ++i) {
+        if (msg[i] != 'x' || !msg[i - 1].isDigit() || msg[i - 2] != '.') {
+            continue;
+        }
+        switch (msg[i + 1].unicode()) {
+        case 'b': case 'B': case 'c': case 'C': case 'd': case 'D': case '.':
+            break;
+        default:
+            continue;
+        }
+        int start = i - 2;
+        while (start > 0 && msg[start - 1].isDigit()) {
+            --start;
+        }
+        return msg.mid(start, i - start + 1);
+    }
+    return QString();
+}
+
+/*
+ * The percentage after tag, e.g. 97 for "fifo  97%". -1 if there is none.
+ */
+static int scanFill(const QString &msg, QLatin1String tag)
+{
+    const int at = msg.indexOf(tag);
+    if (at < 0) {
+        return -1;
+    }
+    const int n = msg.length();
+    int i = at + tag.size();
+    while (i < n && msg[i] == ' ') {
+        ++i;
+    }
+    int ret = 0;
+    const int start = i;
+    while (i < n && msg[i].isDigit()) {
+        ret = ret * 10 + msg[i].digitValue();
+        ++i;
+    }
+    return i > start && i < n && msg[i] == '%' ? ret : -1;
+}
+
+/*!
+ * \brief Media type from the "Media current:" record of xorriso.
+ */
+MediaType mediaTypeFromString(const QString &mt)
+{
+    const static QHash<QString, MediaType> typemap = {
+        { "CD-ROM", MediaType::CD_ROM },
+        { "CD-R", MediaType::CD_R },
+        { "CD-RW", MediaType::CD_RW },
+        { "DVD-ROM", MediaType::DVD_ROM },
+        { "DVD-R", MediaType::DVD_R },
+        { "DVD-RW", MediaType::DVD_RW },
+        { "DVD+R", MediaType::DVD_PLUS_R },
+        { "DVD+R/DL", MediaType::DVD_PLUS_R_DL },
+        { "DVD-RAM", MediaType::DVD_RAM },
+        { "DVD+RW", MediaType::DVD_PLUS_RW },
+        { "BD-ROM", MediaType::BD_ROM },
+        { "BD-R", MediaType::BD_R },
+        { "BD-RE", MediaType::BD_RE }
+    };
+    return typemap.value(mt.left(mt.indexOf(' ')), MediaType::NoMedia);
+}
+
+QString mediaTypeToString(MediaType mt)
+{
+    const static char *names[] = {
+        "none", "CD-ROM", "CD-R", "CD-RW", "DVD-ROM", "DVD-R", "DVD-RW", "DVD+R",
+        "DVD+R/DL", "DVD-RAM", "DVD+RW", "BD-ROM", "BD-R", "BD-RE"
+    };
+    return names[mt];
+}
+
+/*!
+ * \brief Parse a -list_speeds record, e.g. "11080k" and "8.0xD".
+ */
+WriteSpeed writeSpeedFromStrings(const QString &kb, const QString &multiple)
+{
+    WriteSpeed ret;
+    ret.kbps = kb.left(kb.indexOf('k')).toInt();
+    ret.multiple = multiple.left(multiple.indexOf('x')).toDouble();
+    return ret;
+}
+
+/*!
+ * \brief Classify a (trimmed) message from xorriso.
+ *
+ * Every pattern is compiled only once, and a cheap substring test
+ * picks at most one of them for each message.
+ */
+XorrisoMessage XorrisoMessage::classify(const QString &msg)
+{
+    static const QString updateTag = QStringLiteral("UPDATE : ");
+    static const QString regionTag = QStringLiteral("Media region :");
+    static const QRegularExpression percentRe("([0-9.]*)%\\s*(fifo|done)");
+    static const QRegularExpression writtenRe("([0-9]*)\\s*of\\s*([0-9]*) MB written");
+    static const QRegularExpression blocksRe("([0-9]*) blocks read in ([0-9]*) seconds , ([0-9.]*)x");
+    static const QRegularExpression completedRe("Writing to .* completed successfully.");
+
+    XorrisoMessage ret;
+
+    if (msg.startsWith(regionTag)) {
+        ret.type = MediaRegion;
+        const QStringList w = msg.mid(regionTag.length()).split(' ', Qt::SkipEmptyParts);
+        if (w.size() >= 3) {
+            ret.lba = w[0].toLongLong();
+            ret.blocks = w[1].toLongLong();
+            ret.quality = QStringList(w.mid(2)).join(' ');
+        }
+        return ret;
+    }
+
+    static const QLatin1String mismatchTag("MD5 MISMATCH: ");
+    const int mm = msg.indexOf(mismatchTag);
+    if (mm >= 0) {
+        ret.type = MD5Mismatch;
+        ret.path = msg.mid(mm + mismatchTag.size());
+        //shell-quoted by xorriso: '...' with ' as '"'"'
+        if (ret.path.size() >= 2 && ret.path.startsWith('\'') && ret.path.endsWith('\'')) {
+            ret.path = ret.path.mid(1, ret.path.size() - 2).replace("'\"'\"'", "'");
+        }
+        return ret;
+    }
+
+    const int upd = msg.indexOf(updateTag);
+    if (upd >= 0) {
+        const QStringRef body = msg.midRef(upd + updateTag.length());
+        if (body.startsWith(QLatin1String("Closing track/session."))) {
+            ret.type = PhaseChange;
+            ret.phase = ClosingSession;
+            return ret;
+        }
+        if (body.startsWith(QLatin1String("Thank you for being patient."))) {
+            ret.type = PhaseChange;
+            ret.phase = Patience;
+            return ret;
+        }
+    }
+
+    ret.speed = scanSpeed(msg);
+    if (upd >= 0) {
+        ret.fifo = scanFill(msg, QLatin1String("fifo "));
+        ret.buffer = scanFill(msg, QLatin1String("buf "));
+    }
+
+    if (msg.contains(QLatin1String("Blanking done"))
+            || (msg.contains(QLatin1String("completed successfully.")) && completedRe.match(msg).hasMatch())) {
+        ret.type = Completion;
+        return ret;
+    }
+
+    QRegularExpressionMatch m;
+    if (msg.contains(QLatin1String(" MB written"))) {
+        m = writtenRe.match(msg);
+        if (m.hasMatch()) {
+            ret.type = MBWritten;
+            ret.done = m.captured(1).toDouble();
+            ret.total = m.captured(2).toDouble();
+            return ret;
+        }
+    }
+    if (msg.contains(QLatin1String(" blocks read in "))) {
+        m = blocksRe.match(msg);
+        if (m.hasMatch()) {
+            ret.type = BlocksRead;
+            ret.done = m.captured(1).toDouble();
+            return ret;
+        }
+    }
+    if (msg.contains('%')) {
+        m = percentRe.match(msg);
+        if (m.hasMatch()) {
+            ret.type = PercentDone;
+            ret.done = m.captured(1).toDouble();
+            ret.total = 100;
+            return ret;
+        }
+    }
+
+    return ret;
+}
+
+}
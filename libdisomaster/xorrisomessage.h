@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef XORRISOMESSAGE_H
+#define XORRISOMESSAGE_H
+
+#include "disomaster.h"
+#include <QString>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief A message from the xorriso message watcher, classified.
+ *
+ * Use classify() to build one from the raw (trimmed) message text.
+ */
+struct XorrisoMessage
+{
+    enum Type
+    {
+        Other = 0,      // nothing we are interested in
+        PhaseChange,    // job entered a stalled phase, see phase
+        PercentDone,    // done is a percentage (cdrecord / blanking)
+        MBWritten,      // done of total megabytes written (commit)
+        BlocksRead,     // done blocks read (check_media)
+        Completion,     // the job finished successfully
+        MediaRegion,    // a check_media region record, see lba, blocks and quality
+        MD5Mismatch     // a file failed its MD5 check, see path
+    };
+
+    enum Phase
+    {
+        NoPhase = 0,
+        Patience,       // "Thank you for being patient."
+        ClosingSession  // "Closing track/session."
+    };
+
+    Type type = Other;
+    Phase phase = NoPhase;
+    double done = 0;
+    double total = 0;
+    qint64 lba = 0;
+    qint64 blocks = 0;
+    QString quality;
+    QString path;
+    /** \brief Current speed (e.g. "4.0x"), empty if the message carries none.*/
+    QString speed;
+    /** \brief Fill level of the libburn FIFO / of the drive buffer in percent, -1 if the message carries none.*/
+    int fifo = -1;
+    int buffer = -1;
+
+    static XorrisoMessage classify(const QString &msg);
+};
+
+MediaType mediaTypeFromString(const QString &mt);
+QString mediaTypeToString(MediaType mt);
+WriteSpeed writeSpeedFromStrings(const QString &kb, const QString &multiple);
+
+}
+
+#endif // XORRISOMESSAGE_H
@@ -0,0 +1,205 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "xorrisopool.h"
+#include "xorriso.h"
+#include <string.h>
+
+#define PCHAR(s) (char *)(s)
+
+namespace DISOMasterNS {
+
+Q_GLOBAL_STATIC(XorrisoPool, pool)
+
+//libburn initialization is not meant to run concurrently
+static QMutex startuplock;
+
+static int dispatch(void *handle, char *text, int channel)
+{
+    XorrisoPool::Handle *h = static_cast<XorrisoPool::Handle *>(handle);
+    std::lock_guard<std::recursive_mutex> locker(h->lock);
+    if (h->owner) {
+        h->receiver(h->owner, channel, text);
+    }
+    return 1;
+}
+
+static int resultHandler(void *handle, char *text)
+{
+    return dispatch(handle, text, 0);
+}
+
+static int infoHandler(void *handle, char *text)
+{
+    //working around xorriso passing wrong handle to the callback
+    if (strstr(text, "DEBUG : Concurrent message watcher")) {
+        return 1;
+    }
+    return dispatch(handle, text, 1);
+}
+
+XorrisoPool::~XorrisoPool()
+{
+    for (Handle *h : idle) {
+        destroy(h);
+    }
+}
+
+XorrisoPool *XorrisoPool::instance()
+{
+    return pool();
+}
+
+/*!
+ * \brief Lease a handle. Its messages go to receiver, along with owner.
+ * \return the handle, or nullptr if xorriso could not be started.
+ */
+XorrisoPool::Handle *XorrisoPool::lease(void *owner, Receiver receiver)
+{
+    Handle *h = nullptr;
+    {
+        QMutexLocker locker(&lock);
+        if (!idle.isEmpty()) {
+            h = idle.takeLast();
+        }
+    }
+    if (!h) {
+        h = create();
+        if (!h) {
+            return nullptr;
+        }
+    }
+    std::lock_guard<std::recursive_mutex> locker(h->lock);
+    h->owner = owner;
+    h->receiver = receiver;
+    return h;
+}
+
+/*!
+ * \brief Put a leased handle back, once its pending messages reached the owner.
+ */
+void XorrisoPool::giveBack(Handle *h)
+{
+    if (!h) {
+        return;
+    }
+    Xorriso_peek_outlists(h->xorriso, -1, 1, 1 | 2 | 4);
+    {
+        std::lock_guard<std::recursive_mutex> locker(h->lock);
+        h->owner = nullptr;
+        h->receiver = nullptr;
+    }
+    reset(h->xorriso);
+
+    QMutexLocker locker(&lock);
+    if (idle.size() < idlelimit) {
+        idle.push_back(h);
+        return;
+    }
+    locker.unlock();
+    destroy(h);
+}
+
+/*!
+ * \brief Start count idle handles ahead of time.
+ */
+void XorrisoPool::prewarm(int count)
+{
+    for (;;) {
+        {
+            QMutexLocker locker(&lock);
+            if (idle.size() >= qMin(count, idlelimit)) {
+                return;
+            }
+        }
+        Handle *h = create();
+        if (!h) {
+            return;
+        }
+        QMutexLocker locker(&lock);
+        idle.push_back(h);
+    }
+}
+
+/*!
+ * \brief Keep at most count handles idle, 4 by default. 0 disables pooling.
+ */
+void XorrisoPool::setIdleLimit(int count)
+{
+    QList<Handle *> extra;
+    {
+        QMutexLocker locker(&lock);
+        idlelimit = qMax(count, 0);
+        while (idle.size() > idlelimit) {
+            extra.push_back(idle.takeFirst());
+        }
+    }
+    for (Handle *h : extra) {
+        destroy(h);
+    }
+}
+
+int XorrisoPool::idleCount() const
+{
+    QMutexLocker locker(&lock);
+    return idle.size();
+}
+
+XorrisoPool::Handle *XorrisoPool::create()
+{
+    XorrisO *x = nullptr;
+    {
+        QMutexLocker locker(&startuplock);
+        if (Xorriso_new(&x, PCHAR("xorriso"), 0) <= 0) {
+            return nullptr;
+        }
+        if (Xorriso_startup_libraries(x, 0) <= 0) {
+            Xorriso_destroy(&x, 0);
+            return nullptr;
+        }
+    }
+    Handle *h = new Handle;
+    h->xorriso = x;
+    Xorriso_sieve_big(x, 0);
+    Xorriso_start_msg_watcher(x, resultHandler, h, infoHandler, h, 0);
+    return h;
+}
+
+/*
+ * Back to the state of a new handle: no drive, no image, no sieve
+ * records, and the xorriso default of every option a job may set.
+ * Add an option here whenever a job starts setting it.
+ */
+void XorrisoPool::reset(XorrisO *x)
+{
+    Xorriso_option_end(x, 1);
+    Xorriso_sieve_clear_results(x, 0);
+    Xorriso_option_abort_on(x, PCHAR("FAILURE"), 0);
+    Xorriso_option_stdio_sync(x, PCHAR("on"), 0);
+    Xorriso_option_md5(x, PCHAR("off"), 0);
+    Xorriso_option_disk_dev_ino(x, PCHAR("off"), 0);
+    Xorriso_option_pathspecs(x, PCHAR("off"), 0);
+    Xorriso_option_iso_rr_pattern(x, PCHAR("on"), 0);
+    Xorriso_option_overwrite(x, PCHAR("nondir"), 0);
+    Xorriso_option_speed(x, PCHAR("0"), 0);
+    Xorriso_option_volid(x, PCHAR("ISOIMAGE"), 0);
+    Xorriso_option_joliet(x, PCHAR("off"), 0);
+    Xorriso_option_rockridge(x, PCHAR("on"), 0);
+    Xorriso_option_close(x, PCHAR("off"), 0);
+    //write settings, as applyWriteSettings() leaves them without any
+    Xorriso_option_padding(x, PCHAR("300k"), 0);
+    Xorriso_option_fs(x, PCHAR("4m"), 0);
+    Xorriso_option_stream_recording(x, PCHAR("off"), 0);
+    Xorriso_option_dvd_obs(x, PCHAR("default"), 0);
+    Xorriso_set_problem_status(x, PCHAR(""), 0);
+}
+
+void XorrisoPool::destroy(Handle *h)
+{
+    Xorriso_stop_msg_watcher(h->xorriso, 0);
+    Xorriso_destroy(&h->xorriso, 0);
+    delete h;
+}
+
+}
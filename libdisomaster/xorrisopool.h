@@ -0,0 +1,61 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef XORRISOPOOL_H
+#define XORRISOPOOL_H
+
+#include <QList>
+#include <QMutex>
+#include <mutex>
+
+struct XorrisO;
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Process-wide pool of ready xorriso handles.
+ *
+ * A new handle starts up libburn and libisofs, gets the big result
+ * sieve and a message watcher thread of its own. A pooled handle
+ * keeps all of that: it is leased, used, reset and put back for the
+ * next lessee, so neither the setup cost nor the watcher threads grow
+ * with the number of DISOMaster instances created.
+ */
+class XorrisoPool
+{
+public:
+    typedef void (*Receiver)(void *owner, int channel, char *text);
+
+    struct Handle
+    {
+        XorrisO *xorriso = nullptr;
+        std::recursive_mutex lock;  //held while a message is handed to the owner
+        void *owner = nullptr;
+        Receiver receiver = nullptr;
+    };
+
+    ~XorrisoPool();
+
+    static XorrisoPool *instance();
+
+    Handle *lease(void *owner, Receiver receiver);
+    void giveBack(Handle *h);
+
+    void prewarm(int count);
+    void setIdleLimit(int count);
+    int idleCount() const;
+
+private:
+    Handle *create();
+    static void reset(XorrisO *x);
+    static void destroy(Handle *h);
+
+    mutable QMutex lock;
+    QList<Handle *> idle;
+    int idlelimit = 4;
+};
+
+}
+
+#endif // XORRISOPOOL_H
@@ -38,7 +38,7 @@ export PATH=%{_qt5_bindir}:$PATH
 %files
 %doc README.md
 %license LICENSE
-%{_libdir}/lib%{name}.so.1*
+%{_libdir}/lib%{name}.so.2*
 
 %files devel
 %{_includedir}/%{name}
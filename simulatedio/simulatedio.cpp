@@ -0,0 +1,187 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+//the fortified inline read() of glibc would clash with the one below
+#undef _FORTIFY_SOURCE
+
+#include "simulatedio.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DISOMasterNS {
+
+namespace {
+
+struct Simulation
+{
+    int id;
+    dev_t dev;
+    ino_t ino;
+    DriveSimulation sim;
+    QElapsedTimer writetimer;
+    qint64 written;
+};
+
+std::atomic<int> nattached(0);
+std::mutex lock;
+std::vector<Simulation> simulations;
+int nextid = 1;
+
+template <typename F>
+F realFunction(const char *name)
+{
+    return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+// the simulation of the file behind fd, under lock. nullptr if there is none.
+Simulation *lookup(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return nullptr;
+    }
+    for (Simulation &s : simulations) {
+        if (s.dev == st.st_dev && s.ino == st.st_ino) {
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * Delay a read of len bytes at the current offset of the file behind fd.
+ * Returns false if the read has to fail.
+ */
+bool beforeRead(int fd, size_t len)
+{
+    qint64 delay = 0;
+    {
+        std::lock_guard<std::mutex> locker(lock);
+        const Simulation *s = lookup(fd);
+        if (!s) {
+            return true;
+        }
+        const off_t offset = lseek(fd, 0, SEEK_CUR);
+        const qint64 first = offset / 2048;
+        const qint64 end = (qint64(offset) + qint64(len) + 2047) / 2048;
+        delay = qint64(s->sim.readlatency) * (end - first);
+        for (const DriveSimulation::Range &r : s->sim.ranges) {
+            const qint64 overlap = qMin(end, r.lba + r.blocks) - qMax(first, r.lba);
+            if (overlap <= 0) {
+                continue;
+            }
+            if (r.unreadable) {
+                return false;
+            }
+            delay += qint64(r.latency) * overlap;
+        }
+    }
+    if (delay > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(delay));
+    }
+    return true;
+}
+
+// hold a write of len bytes back until it fits the write rate
+void beforeWrite(int fd, size_t len)
+{
+    qint64 wait = 0;
+    {
+        std::lock_guard<std::mutex> locker(lock);
+        Simulation *s = lookup(fd);
+        if (!s || s->sim.writerate <= 0) {
+            return;
+        }
+        if (!s->writetimer.isValid()) {
+            s->writetimer.start();
+        }
+        s->written += len;
+        wait = s->written * 1000000 / s->sim.writerate - s->writetimer.nsecsElapsed() / 1000;
+    }
+    if (wait > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(wait));
+    }
+}
+
+}
+
+/*!
+ * \brief Apply sim to the file image, creating it if it does not exist.
+ * \return an id for detach(), or -1 if the file could not be created.
+ */
+int SimulatedIO::attach(const QString &image, const DriveSimulation &sim)
+{
+    QFile f(image);
+    if (!f.exists() && !f.open(QIODevice::WriteOnly)) {
+        return -1;
+    }
+    f.close();
+    struct stat st;
+    if (stat(QFile::encodeName(image).constData(), &st) != 0) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> locker(lock);
+    Simulation s;
+    s.id = nextid++;
+    s.dev = st.st_dev;
+    s.ino = st.st_ino;
+    s.sim = sim;
+    s.written = 0;
+    simulations.push_back(s);
+    nattached.fetch_add(1, std::memory_order_release);
+    return s.id;
+}
+
+void SimulatedIO::detach(int id)
+{
+    std::lock_guard<std::mutex> locker(lock);
+    for (auto it = simulations.begin(); it != simulations.end(); ++it) {
+        if (it->id == id) {
+            simulations.erase(it);
+            nattached.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+}
+
+using namespace DISOMasterNS;
+
+/*
+ * libburn reads and writes stdio: drives with plain read() / write()
+ * after an lseek().
+ */
+extern "C" {
+
+ssize_t read(int fd, void *buf, size_t len)
+{
+    static const auto real = realFunction<ssize_t (*)(int, void *, size_t)>("read");
+    if (nattached.load(std::memory_order_acquire) && !beforeRead(fd, len)) {
+        errno = EIO;
+        return -1;
+    }
+    return real(fd, buf, len);
+}
+
+ssize_t write(int fd, const void *buf, size_t len)
+{
+    static const auto real = realFunction<ssize_t (*)(int, const void *, size_t)>("write");
+    if (nattached.load(std::memory_order_acquire)) {
+        beforeWrite(fd, len);
+    }
+    return real(fd, buf, len);
+}
+
+}
@@ -0,0 +1,86 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef SIMULATEDIO_H
+#define SIMULATEDIO_H
+
+#include <QList>
+#include <QString>
+
+namespace DISOMasterNS {
+
+/*!
+ * \brief Timing and defects of a simulated drive.
+ */
+struct DriveSimulation
+{
+    struct Range
+    {
+        qint64 lba = 0;
+        qint64 blocks = 0;
+        /** \brief Extra time for every block read in the range, in microseconds.*/
+        int latency = 0;
+        /** \brief Reads touching the range fail.*/
+        bool unreadable = false;
+    };
+    /** \brief Extra time for every block read, in microseconds.*/
+    int readlatency = 0;
+    QList<Range> ranges;
+    /** \brief Write rate in bytes per second, 0 for no limit.*/
+    qint64 writerate = 0;
+};
+
+/*!
+ * \brief I/O of libburn on the image file of a simulated drive.
+ *
+ * A simulated drive is a stdio: pseudo-drive whose image file gets
+ * the timing and defects of a DriveSimulation. Reads that touch an
+ * unreadable range fail with EIO; latency and write rate make the
+ * drive as slow as asked. This makes checkmedia, dumpISO and commit
+ * reproducible on any machine, with no real drive.
+ *
+ * For tests and benchmarks only: read() and write() of the process
+ * are interposed by linking this library. As long as no simulation is
+ * attached they cost one atomic load, otherwise the file behind the
+ * descriptor is looked up and the simulation applied before the real
+ * call.
+ */
+namespace SimulatedIO {
+
+int attach(const QString &image, const DriveSimulation &sim);
+void detach(int id);
+
+}
+
+/*!
+ * \brief A simulation attached to an image file for as long as it lives.
+ */
+class SimulatedDrive
+{
+public:
+    SimulatedDrive(const QString &image, const DriveSimulation &sim)
+        : dev("stdio:" + image),
+          id(SimulatedIO::attach(image, sim))
+    {
+    }
+    ~SimulatedDrive()
+    {
+        if (id >= 0) {
+            SimulatedIO::detach(id);
+        }
+    }
+
+    bool isValid() const { return id >= 0; }
+    /*! \brief The device identifier for DISOMaster::acquireDevice().*/
+    QString device() const { return dev; }
+
+private:
+    Q_DISABLE_COPY(SimulatedDrive)
+    QString dev;
+    int id;
+};
+
+}
+
+#endif // SIMULATEDIO_H
@@ -0,0 +1,14 @@
+QT -= gui
+TARGET = simulatedio
+TEMPLATE = lib
+CONFIG += no_keywords
+
+# test and benchmark builds only, never installed: the library
+# interposes read() and write() of every process linking it
+LIBS += -ldl
+
+SOURCES += \
+        simulatedio.cpp
+
+HEADERS += \
+        simulatedio.h
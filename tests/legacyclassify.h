@@ -0,0 +1,57 @@
+// SPDX-FileCopyrightText: 2019 - 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef LEGACYCLASSIFY_H
+#define LEGACYCLASSIFY_H
+
+#include "../libdisomaster/xorrisomessage.h"
+#include <QRegularExpression>
+
+// what messageReceived used to do for each message, kept as a baseline
+static inline DISOMasterNS::XorrisoMessage legacyClassify(const QString &msg)
+{
+    using DISOMasterNS::XorrisoMessage;
+    XorrisoMessage ret;
+    if (msg.contains("UPDATE : Closing track/session.")) {
+        ret.type = XorrisoMessage::PhaseChange;
+        ret.phase = XorrisoMessage::ClosingSession;
+        return ret;
+    }
+    if (msg.contains("UPDATE : Thank you for being patient.")) {
+        ret.type = XorrisoMessage::PhaseChange;
+        ret.phase = XorrisoMessage::Patience;
+        return ret;
+    }
+    QRegularExpression r("([0-9.]*)%\\s*(fifo|done)");
+    QRegularExpressionMatch m = r.match(msg);
+    if (m.hasMatch()) {
+        ret.type = XorrisoMessage::PercentDone;
+        ret.done = m.captured(1).toDouble();
+        ret.total = 100;
+    }
+    r = QRegularExpression("([0-9]*)\\s*of\\s*([0-9]*) MB written");
+    m = r.match(msg);
+    if (m.hasMatch()) {
+        ret.type = XorrisoMessage::MBWritten;
+        ret.done = m.captured(1).toDouble();
+        ret.total = m.captured(2).toDouble();
+    }
+    r = QRegularExpression("([0-9]*) blocks read in ([0-9]*) seconds , ([0-9.]*)x");
+    m = r.match(msg);
+    if (m.hasMatch()) {
+        ret.type = XorrisoMessage::BlocksRead;
+        ret.done = m.captured(1).toDouble();
+        ret.total = 0;
+    }
+    r = QRegularExpression("([0-9]*\\.[0-9]x)[bBcCdD.]");
+    m = r.match(msg);
+    ret.speed = m.hasMatch() ? m.captured(1) : QString();
+    if (msg.contains("Blanking done") || msg.contains(QRegularExpression("Writing to .* completed successfully."))) {
+        ret.type = XorrisoMessage::Completion;
+        ret.done = ret.total = 0;
+    }
+    return ret;
+}
+
+#endif // LEGACYCLASSIFY_H
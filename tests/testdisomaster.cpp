@@ -3,9 +3,27 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "testdisomaster.h"
+#include "legacyclassify.h"
+#include "../libdisomaster/disomasterfarm.h"
+#include "../libdisomaster/deduplicator.h"
+#include "../libdisomaster/devicemonitor.h"
+#include "../libdisomaster/dumpfollower.h"
+#include "../libdisomaster/mediaprofiles.h"
+#include "../libdisomaster/messagelog.h"
+#include "../libdisomaster/spanplanner.h"
+#include "../libdisomaster/stagingtree.h"
+#include "../libdisomaster/watcherchannel.h"
+#include "../libdisomaster/xorrisomessage.h"
+#include "../simulatedio/simulatedio.h"
 #include <QtConcurrent/QtConcurrent>
 #include <QFuture>
 #include <QMetaType>
+#include <QElapsedTimer>
+#include <QSet>
+#include <algorithm>
+#include <atomic>
+#include <sys/stat.h>
+#include <thread>
 
 using namespace DISOMasterNS;
 
@@ -157,4 +175,1327 @@ void TestDISOMaster::test_dumpISO()
     delete x;
 }
 
+void TestDISOMaster::test_asyncJobs()
+{
+    if (!qEnvironmentVariableIsSet("DISOMASTERTEST_DEVICE")) {
+        QSKIP("DISOMASTERTEST_DEVICE not set");
+    }
+    const QString dev = QString(qgetenv("DISOMASTERTEST_DEVICE"));
+
+    DISOMaster *x = new DISOMaster;
+    QVERIFY(x->acquireDevice(dev));
+
+    // both jobs are driven from this (the test's) thread
+    QFutureWatcher<JobResult> w;
+    int progress = -1;
+    connect(&w, &QFutureWatcher<JobResult>::progressValueChanged, [&progress](int v) { progress = v; });
+    QFuture<JobResult> erase = x->eraseAsync();
+    QFuture<JobResult> check = x->checkmediaAsync();
+    w.setFuture(check);
+
+    QTRY_VERIFY_WITH_TIMEOUT(check.isFinished(), 360000);
+    QVERIFY(erase.isFinished());
+    QVERIFY(erase.result().success);
+    QVERIFY(check.result().success);
+    QVERIFY(check.result().elapsed > 0);
+    QVERIFY(progress >= 0);
+    QCOMPARE(x->lastJobResult().qgood, check.result().qgood);
+
+    x->releaseDevice();
+    delete x;
+}
+
+void TestDISOMaster::test_streamWriteISO()
+{
+    if (!qEnvironmentVariableIsSet("DISOMASTERTEST_ISOFILE")) {
+        QSKIP("DISOMASTERTEST_ISOFILE not set");
+    }
+    const QString iso = QString(qgetenv("DISOMASTERTEST_ISOFILE"));
+    const qint64 size = QFileInfo(iso).size();
+
+    QTemporaryDir dir;
+    const QString copy = dir.filePath("stream.iso");
+    DISOMaster x;
+    QVERIFY(x.acquireDevice("stdio:" + copy));
+
+    // a sequential source, as from a pipeline stage
+    QProcess cat;
+    cat.start("cat", QStringList() << iso, QIODevice::ReadOnly);
+    QVERIFY(cat.waitForStarted());
+    int fills = 0;
+    connect(&x, &DISOMaster::bufferFillChanged, this, [&fills](int, int) { ++fills; }, Qt::DirectConnection);
+    QVERIFY(x.writeISO(&cat, size));
+    cat.waitForFinished();
+    x.releaseDevice();
+    fprintf(stderr, "fill reports: %d, lowest fifo: %d%%\n", fills, x.lastJobResult().minfifo);
+
+    QFile src(iso), dst(copy);
+    QVERIFY(src.open(QIODevice::ReadOnly));
+    QVERIFY(dst.open(QIODevice::ReadOnly));
+    QCOMPARE(dst.read(1 << 20), src.read(1 << 20));
+    dst.close();
+
+    // a cancelled job does not cut the next stream short
+    QVERIFY(src.seek(0));
+    const QByteArray image = src.readAll();
+    QVERIFY(x.acquireDevice("stdio:" + copy));
+    QFuture<JobResult> check = x.checkmediaRangeAsync(0);
+    x.cancel();
+    check.waitForFinished();
+    QBuffer whole;
+    whole.setData(image);
+    QVERIFY(whole.open(QIODevice::ReadOnly));
+    QVERIFY(x.writeISO(&whole, size));
+    x.releaseDevice();
+
+    // a source that ends early fails the burn, one that is empty burns nothing
+    const QString cut = dir.filePath("cut.iso");
+    QVERIFY(x.acquireDevice("stdio:" + cut));
+    QBuffer half;
+    half.setData(image.left(image.size() / 2));
+    QVERIFY(half.open(QIODevice::ReadOnly));
+    QVERIFY(!x.writeISO(&half, size));
+    QVERIFY(!x.lastJobResult().success);
+    x.releaseDevice();
+    const QString none = dir.filePath("none.iso");
+    QVERIFY(x.acquireDevice("stdio:" + none));
+    QBuffer empty;
+    QVERIFY(empty.open(QIODevice::ReadOnly));
+    QVERIFY(!x.writeISO(&empty, size));
+    x.releaseDevice();
+    QCOMPARE(QFileInfo(none).size(), qint64(0));
+}
+
+void TestDISOMaster::test_commitVerify()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QDir(dir.path()).mkdir("data");
+    for (int i = 0; i < 4; ++i) {
+        QFile f(dir.filePath(QString("data/file%1").arg(i)));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(QByteArray(100000 * (i + 1), char('a' + i)));
+    }
+
+    // a stdio: pseudo-drive behaves like blank writable media
+    DISOMaster x;
+    QVERIFY(x.acquireDevice("stdio:" + dir.filePath("verify.iso")));
+    QList<DISOMaster::JobStatus> seen;
+    connect(&x, &DISOMaster::jobStatusChanged, this, [&seen](DISOMaster::JobStatus s, int) {
+        if (seen.isEmpty() || seen.last() != s) {
+            seen.push_back(s);
+        }
+    }, Qt::DirectConnection);
+
+    x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+    QVERIFY(x.commit(VerifyDatas | RockRidgeSupport));
+    const JobResult res = x.lastJobResult();
+    QVERIFY(res.success);
+    QVERIFY(res.mismatches.isEmpty());
+    QVERIFY(seen.contains(DISOMaster::JobStatus::Verifying));
+    QCOMPARE(seen.last(), DISOMaster::JobStatus::Finished);
+    QVERIFY(seen.indexOf(DISOMaster::JobStatus::Finished) > seen.indexOf(DISOMaster::JobStatus::Verifying));
+    x.releaseDevice();
+
+    // a block of file3 goes bad between writing and verifying
+    const QString bad = dir.filePath("bad.iso");
+    DISOMaster y;
+    QVERIFY(y.acquireDevice("stdio:" + bad));
+    bool corrupted = false;
+    connect(&y, &DISOMaster::jobStatusChanged, this, [&bad, &corrupted](DISOMaster::JobStatus s, int) {
+        if (s != DISOMaster::JobStatus::Verifying || corrupted) {
+            return;
+        }
+        QFile img(bad);
+        if (!img.open(QIODevice::ReadWrite)) {
+            return;
+        }
+        const int at = img.readAll().indexOf(QByteArray(2048, 'd'));
+        corrupted = at >= 0 && img.seek(at) && img.write(QByteArray(2048, 'x')) == 2048;
+    }, Qt::DirectConnection);
+    y.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+    QVERIFY(!y.commit(VerifyDatas | RockRidgeSupport));
+    QVERIFY(corrupted);
+    QCOMPARE(y.lastJobResult().mismatches, QStringList() << "/data/file3");
+    y.releaseDevice();
+}
+
+void TestDISOMaster::test_commitIncremental()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QDir(dir.path()).mkdir("data");
+    for (int i = 0; i < 4; ++i) {
+        QFile f(dir.filePath(QString("data/file%1").arg(i)));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(QByteArray(100000, char('a' + i)));
+    }
+    const QString dev = "stdio:" + dir.filePath("backup.iso");
+    const QHash<QUrl, QUrl> files { { QUrl(dir.filePath("data")), QUrl("/data") } };
+    // files touched in the second the session starts count as changed
+    QTest::qWait(1100);
+
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(dev));
+    x.stageFiles(files);
+    QVERIFY(x.commit(KeepAppendable | RockRidgeSupport));
+    x.releaseDevice();
+
+    // one file changed since
+    QFile f(dir.filePath("data/file2"));
+    QVERIFY(f.open(QIODevice::Append));
+    f.write("more");
+    f.close();
+
+    QVERIFY(x.acquireDevice(dev));
+    x.stageFiles(files);
+    QVERIFY(x.commit(KeepAppendable | RockRidgeSupport | Incremental));
+    const JobResult res = x.lastJobResult();
+    x.releaseDevice();
+    fprintf(stderr, "updated %d files (%lld bytes), skipped %d files (%lld bytes)\n",
+            res.updatedfiles, res.updatedbytes, res.skippedfiles, res.skippedbytes);
+    QCOMPARE(res.updatedfiles, 1);
+    QCOMPARE(res.updatedbytes, qint64(100004));
+    QCOMPARE(res.skippedfiles, 3);
+    QCOMPARE(res.skippedbytes, qint64(300000));
+}
+
+void TestDISOMaster::test_deduplicate()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QDir(dir.path()).mkpath("data/sub");
+    const QByteArray content(300000, 'x');
+    const QStringList names { "data/a", "data/sub/b", "data/sub/c", "data/d", "data/e" };
+    for (const QString &name : names) {
+        QFile f(dir.filePath(name));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        // d has the size but not the content of the others, e is unique
+        f.write(name == "data/d" ? QByteArray(300000, 'y') : name == "data/e" ? QByteArray(10, 'z') : content);
+    }
+
+    const QList<StagingTree::Entry> entries { { dir.filePath("data"), "/data" } };
+    const int cached = Deduplicator::cacheSize();
+    QList<Deduplicator::Duplicate> dups = Deduplicator::find(entries);
+    QCOMPARE(dups.size(), 2);
+    QCOMPARE(dups[0].original, QString("/data/a"));
+    QCOMPARE(dups[0].target, QString("/data/sub/b"));
+    QCOMPARE(dups[1].target, QString("/data/sub/c"));
+    QCOMPARE(dups[0].source, dir.filePath("data/sub/b"));
+    QCOMPARE(Deduplicator::cacheSize(), cached + 4);
+    // staged again: served from the cache
+    QCOMPARE(Deduplicator::find(entries).size(), 2);
+    QCOMPARE(Deduplicator::cacheSize(), cached + 4);
+
+    DISOMaster x;
+    QVERIFY(x.acquireDevice("stdio:" + dir.filePath("dedup.iso")));
+    x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+    QVERIFY(x.commit(RockRidgeSupport | Deduplicate));
+    x.releaseDevice();
+    QCOMPARE(x.lastJobResult().dedupfiles, 2);
+    QCOMPARE(x.lastJobResult().dedupbytes, qint64(600000));
+    // only one copy of the data made it to the image
+    QVERIFY(QFileInfo(dir.filePath("dedup.iso")).size() < 2 * 300000 + (1 << 20));
+
+    // d rewritten in place under its old mtime: its digest is not taken from the cache
+    QFile d(dir.filePath("data/d"));
+    const QDateTime mtime = QFileInfo(d).lastModified();
+    QVERIFY(d.open(QIODevice::ReadWrite));
+    d.write(content);
+    QVERIFY(d.setFileTime(mtime, QFileDevice::FileModificationTime));
+    d.close();
+    QCOMPARE(Deduplicator::find(entries).size(), 3);
+}
+
+void TestDISOMaster::test_buildImage()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QDir(dir.path()).mkdir("data");
+    QFile f(dir.filePath("data/file"));
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write(QByteArray(1 << 20, 'x'));
+    f.close();
+
+    // a stale image must be replaced, not appended to
+    const QString iso = dir.filePath("out.iso");
+    QFile stale(iso);
+    QVERIFY(stale.open(QIODevice::WriteOnly));
+    stale.write(QByteArray(8 << 20, 's'));
+    stale.close();
+
+    DISOMaster x;
+    x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+    QVERIFY(x.buildImage(QUrl::fromLocalFile(iso), RockRidgeSupport | Preallocate, "BUILD"));
+    QVERIFY(x.lastJobResult().throughput > 0);
+    const qint64 size = QFileInfo(iso).size();
+    QVERIFY(size > (1 << 20) && size < (4 << 20));
+
+    // staged files stay staged
+    QVERIFY(x.buildImage(QUrl::fromLocalFile(iso)));
+    QCOMPARE(QFileInfo(iso).size() / (1 << 20), size / (1 << 20));
+
+    // not while a drive is held
+    QVERIFY(x.acquireDevice("stdio:" + dir.filePath("drive.iso")));
+    QVERIFY(!x.buildImage(QUrl::fromLocalFile(iso)));
+    x.releaseDevice();
+}
+
+void TestDISOMaster::test_addPathspecs()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    // '=' separates the two paths of a pathspec, '\' escapes
+    QDir(dir.path()).mkpath("odd=dir");
+    const QStringList names { "odd=dir/plain", "odd=dir/x=y", "back\\slash", "trailing\\" };
+    //contents that do not repeat the names, which are looked for in the image
+    for (int i = 0; i < names.size(); ++i) {
+        QFile f(dir.filePath(names[i]));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write("payload #" + QByteArray::number(i));
+    }
+    const auto imageOf = [](const QString &path) {
+        QFile f(path);
+        return f.open(QIODevice::ReadOnly) ? f.readAll() : QByteArray();
+    };
+
+    DISOMaster x;
+    x.stageFiles({ { QUrl(dir.filePath("odd=dir")), QUrl("/a=b") } });
+    QVERIFY(x.buildImage(QUrl::fromLocalFile(dir.filePath("urls.iso")), RockRidgeSupport));
+    QByteArray image = imageOf(dir.filePath("urls.iso"));
+    QVERIFY(image.contains("payload #0"));
+    QVERIFY(image.contains("payload #1"));
+    QVERIFY(image.contains("a=b"));
+    QVERIFY(!image.contains("a\\=b"));
+
+    // QUrl encodes '\', a disc plan stages paths as they are
+    DiscPlan plan;
+    plan.disc = 1;
+    for (const QString &name : names) {
+        SpanFile f;
+        f.source = dir.filePath(name);
+        f.target = "/c\\=d/" + name.section('/', -1);
+        plan.files.push_back(f);
+    }
+    x.stageDiscPlan(plan);
+    QVERIFY(x.buildImage(QUrl::fromLocalFile(dir.filePath("plain.iso")), RockRidgeSupport));
+    image = imageOf(dir.filePath("plain.iso"));
+    for (int i = 0; i < names.size(); ++i) {
+        QVERIFY2(image.contains("payload #" + QByteArray::number(i)), names[i].toUtf8().constData());
+    }
+    // Rock Ridge names as staged, not as escaped
+    QVERIFY(image.contains("c\\=d"));
+    QVERIFY(image.contains("x=y"));
+    QVERIFY(image.contains("back\\slash"));
+    QVERIFY(image.contains("trailing\\"));
+    QVERIFY(!image.contains("c\\\\\\=d"));
+    QVERIFY(!image.contains("back\\\\slash"));
+}
+
+void TestDISOMaster::test_writeSettings()
+{
+    WriteSettings bd = WriteSettings::forMedia(MediaType::BD_RE);
+    QCOMPARE(bd.streamrecording, WriteSettings::StreamOn);
+    QCOMPARE(WriteSettings::forMedia(MediaType::DVD_RAM).streamrecording, WriteSettings::StreamOn);
+    QCOMPARE(WriteSettings::forMedia(MediaType::DVD_PLUS_R).streamrecording, WriteSettings::StreamOff);
+    QCOMPARE(WriteSettings::forMedia(MediaType::CD_R).padding, qint64(300 << 10));
+
+    // nothing is tuned unless asked for
+    DISOMaster x;
+    QCOMPARE(x.writeSettings().streamrecording, WriteSettings::StreamDefault);
+    QCOMPARE(x.writeSettings().padding, qint64(-1));
+    WriteSettings ws;
+    ws.fifosize = 1 << 20;
+    x.setWriteSettings(ws);
+    QCOMPARE(x.writeSettings().fifosize, qint64(1 << 20));
+    QCOMPARE(x.writeSettings().streamrecording, WriteSettings::StreamDefault);
+
+    // xorriso pads the session of a stdio: drive by 300 KiB, unless told otherwise
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QFile f(dir.filePath("file"));
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write(QByteArray(100000, 'w'));
+    f.close();
+    qint64 sizes[2];
+    for (int i = 0; i < 2; ++i) {
+        DISOMaster y;
+        if (i) {
+            WriteSettings nopad;
+            nopad.padding = 0;
+            y.setWriteSettings(nopad);
+        }
+        const QString iso = dir.filePath(QString("pad%1.iso").arg(i));
+        QVERIFY(y.acquireDevice("stdio:" + iso));
+        y.stageFiles({ { QUrl(dir.filePath("file")), QUrl("/file") } });
+        QVERIFY(y.commit(BurnOptions(RockRidgeSupport)));
+        y.releaseDevice();
+        sizes[i] = QFileInfo(iso).size();
+    }
+    QCOMPARE(sizes[0] - sizes[1], qint64(300 << 10));
+}
+
+void TestDISOMaster::test_mediaProfiles()
+{
+    const int dvd1x = 1385;
+    QList<WriteSpeed> speeds;
+    for (int x : { 16, 2, 4, 12, 8 }) {
+        WriteSpeed ws;
+        ws.kbps = x * dvd1x;
+        ws.multiple = x;
+        speeds.push_back(ws);
+    }
+
+    // nothing known: up to the default of DVD+R
+    MediaProfiles::Profile p;
+    QCOMPARE(MediaProfiles::choose(p, DVD_PLUS_R, speeds), 8 * dvd1x);
+    QCOMPARE(MediaProfiles::choose(p, BD_R, {}), int(WriteSpeed::Max));
+
+    // a few clean burns at 8x: 12x is tried next
+    MediaProfiles::SpeedRecord clean;
+    clean.kbps = 8 * dvd1x;
+    clean.jobs = 3;
+    p.speeds = { clean };
+    QCOMPARE(MediaProfiles::choose(p, DVD_PLUS_R, speeds), 12 * dvd1x);
+
+    // 12x made a coaster: back to 8x
+    MediaProfiles::SpeedRecord coaster;
+    coaster.kbps = 12 * dvd1x;
+    coaster.jobs = 1;
+    coaster.failures = 1;
+    p.speeds.push_back(coaster);
+    QCOMPARE(MediaProfiles::choose(p, DVD_PLUS_R, speeds), 8 * dvd1x);
+
+    // discs burnt at 8x read back badly: 8x and up are out
+    p.speeds[0].checks = 1;
+    p.speeds[0].qbad = 0.05;
+    QCOMPARE(MediaProfiles::choose(p, DVD_PLUS_R, speeds), 4 * dvd1x);
+
+    // bad checks at unknown speeds: one step below the default
+    MediaProfiles::Profile weak;
+    weak.checks = 2;
+    weak.qbad = 0.1;
+    QCOMPARE(MediaProfiles::choose(weak, DVD_PLUS_R, speeds), 4 * dvd1x);
+
+    const WriteSpeed parsed = writeSpeedFromStrings("11080k", "8.0xD");
+    QCOMPARE(parsed.kbps, 11080);
+    QCOMPARE(parsed.multiple, 8.0);
+
+    // an auto speed burn lands in the database
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QDir(dir.path()).mkdir("data");
+    QFile f(dir.filePath("data/file"));
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write(QByteArray(1 << 20, 'p'));
+    f.close();
+
+    const QString olddb = DISOMaster::mediaProfileDatabase();
+    QVERIFY(olddb.isEmpty());
+    const QString db = dir.filePath("profiles/mediaprofiles.json");
+    DISOMaster::setMediaProfileDatabase(db);
+    DISOMaster x;
+    QVERIFY(x.acquireDevice("stdio:" + dir.filePath("disc.iso")));
+    x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+    QVERIFY(x.commit(KeepAppendable | RockRidgeSupport, WriteSpeed::Auto));
+    const JobResult res = x.lastJobResult();
+    QVERIFY(res.autospeed);
+    QVERIFY(res.writespeed >= 0);
+    const QString key = MediaProfiles::key(x.getDeviceProperty(MediaTypeField));
+    x.releaseDevice();
+    QVERIFY(QFile::exists(db));
+
+    //read back from the file
+    DISOMaster::setMediaProfileDatabase(db);
+    bool recorded = false;
+    for (const MediaProfiles::SpeedRecord &r : MediaProfiles::instance()->profile(key).speeds) {
+        recorded = recorded || (r.kbps == res.writespeed && r.jobs == 1 && r.failures == 0);
+    }
+    QVERIFY(recorded);
+    DISOMaster::setMediaProfileDatabase(olddb);
+
+    //two writers of one file (as if two processes) lose no update
+    const QString shared = dir.filePath("profiles/shared.json");
+    MediaProfiles a, b;
+    a.setPath(shared);
+    b.setPath(shared);
+    auto burn = [](MediaProfiles *m) {
+        for (int i = 0; i < 50; ++i) {
+            m->recordWrite("CD-R/x/y", 1000, true);
+        }
+    };
+    std::thread ta(burn, &a), tb(burn, &b);
+    ta.join();
+    tb.join();
+    QCOMPARE(a.profile("CD-R/x/y").speeds.value(0).jobs, 100);
+}
+
+void TestDISOMaster::test_progressEvents()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QDir(dir.path()).mkdir("data");
+    QFile f(dir.filePath("data/file"));
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write(QByteArray(64 << 20, 'p'));
+    f.close();
+
+    DISOMaster x;
+    x.setProgressInterval(1000);
+    QVERIFY(x.acquireDevice("stdio:" + dir.filePath("progress.iso")));
+    x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+
+    QList<JobProgress> events;
+    int statuses = 0;
+    int fills = 0;
+    connect(&x, &DISOMaster::bufferFillChanged, this, [&fills] { ++fills; }, Qt::DirectConnection);
+    connect(&x, &DISOMaster::progressChanged, this, [&events](const JobProgress &p) {
+        events.push_back(p);
+    }, Qt::DirectConnection);
+    connect(&x, &DISOMaster::jobStatusChanged, this, [&statuses] { ++statuses; }, Qt::DirectConnection);
+    QElapsedTimer t;
+    t.start();
+    QVERIFY(x.commit(BurnOptions(RockRidgeSupport)));
+    const qint64 ms = t.elapsed();
+    x.releaseDevice();
+
+    fprintf(stderr, "%lld ms: %d progress events, %d fill events, %d status events\n", ms, events.size(), fills, statuses);
+    QVERIFY(events.size() >= 2);
+    // at most one per interval, plus the forced ones (start, phases, end)
+    QVERIFY(events.size() <= ms / 1000 + 4);
+    QVERIFY(fills <= events.size());
+    QVERIFY(statuses <= 110);
+    QCOMPARE(events.first().phase, JobProgress::Writing);
+    QCOMPARE(events.last().percent, 100.);
+    QCOMPARE(x.progress().percent, 100.);
+    for (int i = 1; i < events.size(); ++i) {
+        QVERIFY(events[i].elapsed >= events[i - 1].elapsed);
+    }
+}
+
+void TestDISOMaster::test_deviceChanged()
+{
+    //instances come and go while the monitor thread delivers events
+    {
+        std::atomic<bool> stop { false };
+        std::thread monitor([&stop] {
+            while (!stop) {
+                Q_EMIT DeviceMonitor::instance()->deviceEvent("/dev/sr-none", DISOMaster::MediaChanged);
+            }
+        });
+        for (int i = 0; i < 200; ++i) {
+            DISOMaster x;
+            x.getDevicePropertyCached("/dev/sr-none");
+        }
+        stop = true;
+        monitor.join();
+    }
+
+    if (!qEnvironmentVariableIsSet("DISOMASTERTEST_DEVICE")) {
+        QSKIP("DISOMASTERTEST_DEVICE not set");
+    }
+    const QString dev = QString(qgetenv("DISOMASTERTEST_DEVICE"));
+    qRegisterMetaType<DISOMaster::DeviceEvent>(QT_STRINGIFY(DISOMaster::DeviceEvent));
+
+    DISOMaster x;
+    QSignalSpy spy(&x, &DISOMaster::deviceChanged);
+    QVERIFY(x.acquireDevice(dev));
+    x.getDeviceProperty();
+    QVERIFY(!x.getDevicePropertyCached(dev).devid.isEmpty());
+
+    // what the monitor thread reports after a disc swap
+    Q_EMIT DeviceMonitor::instance()->deviceEvent(QFileInfo(dev).canonicalFilePath(), DISOMaster::MediaChanged);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first().at(0).toString(), dev);
+    QVERIFY(x.getDevicePropertyCached(dev).devid.isEmpty());
+    x.releaseDevice();
+}
+
+void TestDISOMaster::test_devicePropertyFields()
+{
+    if (!qEnvironmentVariableIsSet("DISOMASTERTEST_DEVICE")) {
+        QSKIP("DISOMASTERTEST_DEVICE not set");
+    }
+    const QString dev = QString(qgetenv("DISOMASTERTEST_DEVICE"));
+
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(dev));
+    x.nullifyDevicePropertyCache(dev);
+
+    DeviceProperty dp = x.getDeviceProperty(MediaTypeField);
+    const qint64 partial = x.devicePropertyLatency();
+    QVERIFY(x.devicePropertyTimestamp(dev, MediaTypeField).isValid());
+    QVERIFY(!x.devicePropertyTimestamp(dev, WriteSpeedField).isValid());
+    QVERIFY(dp.writespeed.isEmpty());
+
+    // served from the cache
+    x.getDeviceProperty(MediaTypeField);
+    QCOMPARE(x.devicePropertyLatency(), qint64(0));
+
+    dp = x.getDeviceProperty();
+    const qint64 full = x.devicePropertyLatency();
+    QVERIFY(x.devicePropertyTimestamp(dev, WriteSpeedField).isValid());
+    fprintf(stderr, "media type only: %lld us, full query: %lld us\n", partial, full);
+    x.releaseDevice();
+}
+
+void TestDISOMaster::test_listDevices()
+{
+    QElapsedTimer t;
+    t.start();
+    const QList<DeviceInfo> devs = DISOMaster::listDevices(true);
+    const qint64 probe = t.restart();
+    QCOMPARE(DISOMaster::listDevices().size(), devs.size());
+    const qint64 cached = t.elapsed();
+    for (const DeviceInfo &i : devs) {
+        fprintf(stderr, "%s: %s %s, available %d, media %d\n", i.devid.toUtf8().data(),
+                i.vendor.toUtf8().data(), i.product.toUtf8().data(), i.available, i.media);
+    }
+    fprintf(stderr, "%d drives probed in %lld ms, cached lookup %lld ms\n", devs.size(), probe, cached);
+
+    if (qEnvironmentVariableIsSet("DISOMASTERTEST_DEVICE")) {
+        const QString dev = QString(qgetenv("DISOMASTERTEST_DEVICE"));
+        QVERIFY(std::any_of(devs.cbegin(), devs.cend(), [&dev](const DeviceInfo &i) {
+            return i.devid == QFileInfo(dev).canonicalFilePath();
+        }));
+    }
+}
+
+void TestDISOMaster::test_farmWriteISO()
+{
+    if (!qEnvironmentVariableIsSet("DISOMASTERTEST_ISOFILE")) {
+        QSKIP("DISOMASTERTEST_ISOFILE not set");
+    }
+    const QString iso = QString(qgetenv("DISOMASTERTEST_ISOFILE"));
+
+    // stdio: pseudo-drives, one image file each
+    QTemporaryDir dir;
+    QStringList devs;
+    for (int i = 0; i < 3; ++i) {
+        devs.push_back(QString("stdio:%1/copy%2.iso").arg(dir.path()).arg(i));
+    }
+
+    DISOMasterFarm farm;
+    farm.setBufferSize(8, 1 << 20);
+    QCOMPARE(farm.acquireDevices(devs), 3);
+    QVERIFY(farm.writeISO(QUrl::fromLocalFile(iso)));
+
+    QFile src(iso);
+    QVERIFY(src.open(QIODevice::ReadOnly));
+    const QByteArray expected = src.read(1 << 20);
+    for (const ReplicaResult &r : farm.lastResults()) {
+        QVERIFY(r.success);
+        QCOMPARE(r.bytes, quint64(src.size()));
+        fprintf(stderr, "%s: %.1f MB/s\n", r.devid.toUtf8().data(), r.throughput / 1e6);
+
+        QFile copy(r.devid.mid(int(strlen("stdio:"))));
+        QVERIFY(copy.open(QIODevice::ReadOnly));
+        QCOMPARE(copy.read(1 << 20), expected);
+    }
+    fprintf(stderr, "aggregate: %.1f MB/s\n", farm.aggregateThroughput() / 1e6);
+    farm.releaseDevices();
+
+    // a drive that fails is dropped, the others finish
+    const QString broken = dir.filePath("broken.iso");
+    const QStringList mixed { "stdio:" + dir.filePath("good0.iso"), "stdio:" + broken, "stdio:" + dir.filePath("good1.iso") };
+    QCOMPARE(farm.acquireDevices(mixed), 3);
+    // libburn opens the file once writing starts, a directory there cannot be written
+    QFile::remove(broken);
+    QVERIFY(QDir(dir.path()).mkdir("broken.iso"));
+    QSignalSpy failed(&farm, &DISOMasterFarm::deviceFailed);
+    QVERIFY(farm.writeISO(QUrl::fromLocalFile(iso)));
+    QCOMPARE(failed.count(), 1);
+    QCOMPARE(failed.first().at(0).toString(), "stdio:" + broken);
+    QCOMPARE(farm.lastResults().size(), 3);
+    for (const ReplicaResult &r : farm.lastResults()) {
+        if (r.devid == "stdio:" + broken) {
+            QVERIFY(!r.success);
+            continue;
+        }
+        QVERIFY(r.success);
+        QCOMPARE(r.bytes, quint64(src.size()));
+        QFile copy(r.devid.mid(int(strlen("stdio:"))));
+        QVERIFY(copy.open(QIODevice::ReadOnly));
+        QCOMPARE(copy.read(1 << 20), expected);
+    }
+    farm.releaseDevices();
+}
+
+static QStringList loadMessageLog()
+{
+    QFile f(QFINDTESTDATA("data/xorriso-messages.log"));
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QStringList();
+    }
+    QStringList ret;
+    while (!f.atEnd()) {
+        ret.push_back(QString(f.readLine()).trimmed());
+    }
+    return ret;
+}
+
+void TestDISOMaster::test_checkMediaRange()
+{
+    //a burn on the same handle: the scan covers the new data, not the cached size
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QDir(dir.path()).mkdir("data");
+        QFile f(dir.filePath("data/file"));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(QByteArray(4 << 20, 'c'));
+        f.close();
+
+        DISOMaster x;
+        QVERIFY(x.acquireDevice("stdio:" + dir.filePath("disc.iso")));
+        x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+        QVERIFY(x.commit(KeepAppendable | RockRidgeSupport));
+        const qint64 first = qint64(x.getDeviceProperty(CapacityField).datablocks);
+        x.stageFiles({ { QUrl(dir.filePath("data/file")), QUrl("/more") } });
+        QVERIFY(x.commit(KeepAppendable | RockRidgeSupport));
+        QVERIFY(x.checkmediaRange(0, -1, false));
+        const qint64 used = qint64(x.getDeviceProperty(CapacityField).datablocks);
+        QVERIFY(used > first);
+        const JobResult res = x.lastJobResult();
+        QVERIFY(!res.regions.isEmpty());
+        QCOMPARE(res.regions.last().start + res.regions.last().length, used);
+        x.releaseDevice();
+    }
+
+    if (!qEnvironmentVariableIsSet("DISOMASTERTEST_DEVICE")) {
+        QSKIP("DISOMASTERTEST_DEVICE not set");
+    }
+    const QString dev = QString(qgetenv("DISOMASTERTEST_DEVICE"));
+
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(dev));
+    const qint64 used = qint64(x.getDeviceProperty(CapacityField).datablocks);
+    if (used < 64) {
+        x.releaseDevice();
+        QSKIP("no data on the media");
+    }
+
+    QList<MediaRegion> streamed;
+    connect(&x, &DISOMaster::mediaRegionChecked, this, [&streamed](MediaRegion r) {
+        streamed.push_back(r);
+    }, Qt::DirectConnection);
+
+    //the second half of the used area only
+    QVERIFY(x.checkmediaRange(used / 2, used - used / 2));
+    const JobResult res = x.lastJobResult();
+    QVERIFY(!streamed.isEmpty());
+    QVERIFY(!res.regions.isEmpty());
+    QCOMPARE(res.regions.first().start, used / 2);
+    qint64 next = used / 2;
+    for (const MediaRegion &r : res.regions) {
+        QCOMPARE(r.start, next);
+        next += r.length;
+    }
+    QCOMPARE(next, used);
+    QVERIFY(qAbs(res.qgood + res.qslow + res.qbad - 1) < 1e-6);
+    x.releaseDevice();
+}
+
+void TestDISOMaster::test_simulatedDrive()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QDir(dir.path()).mkdir("data");
+    QFile f(dir.filePath("data/file"));
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write(QByteArray(8 << 20, 's'));
+    f.close();
+
+    const QString image = dir.filePath("disc.iso");
+    {
+        DISOMaster x;
+        x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+        QVERIFY(x.buildImage(QUrl::fromLocalFile(image)));
+    }
+
+    // a known map: one unreadable range, a slow start
+    const qint64 badlba = 2048;
+    const qint64 badblocks = 64;
+    DriveSimulation sim;
+    DriveSimulation::Range bad;
+    bad.lba = badlba;
+    bad.blocks = badblocks;
+    bad.unreadable = true;
+    DriveSimulation::Range slow;
+    slow.lba = 0;
+    slow.blocks = 512;
+    slow.latency = 200;
+    sim.ranges = { bad, slow };
+
+    SimulatedDrive drive(image, sim);
+    QVERIFY(drive.isValid());
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(drive.device()));
+    const qint64 used = qint64(x.getDeviceProperty(CapacityField).datablocks);
+    QVERIFY(used > badlba + badblocks);
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(x.checkmediaRange(0));
+    const qint64 ms = timer.elapsed();
+    x.releaseDevice();
+
+    const JobResult res = x.lastJobResult();
+    QVERIFY(ms >= 512 * 200 / 1000);
+    QVERIFY(res.qbad > 0);
+    bool covered = false;
+    qint64 next = 0;
+    for (const MediaRegion &r : res.regions) {
+        QCOMPARE(r.start, next);
+        next += r.length;
+        if (r.quality == MediaRegion::Bad) {
+            // reads are done in chunks of 32 blocks
+            QVERIFY(r.start >= badlba - 32 && r.start + r.length <= badlba + badblocks + 32);
+            covered = covered || (r.start <= badlba && r.start + r.length >= badlba + badblocks);
+        }
+    }
+    QVERIFY(covered);
+    QCOMPARE(next, used);
+
+    // a throttled burn takes as long as the rate says
+    DriveSimulation throttled;
+    throttled.writerate = 16 << 20;
+    SimulatedDrive burner(dir.filePath("burnt.iso"), throttled);
+    QVERIFY(burner.isValid());
+    DISOMaster w;
+    QVERIFY(w.acquireDevice(burner.device()));
+    timer.restart();
+    QVERIFY(w.writeISO(QUrl::fromLocalFile(image)));
+    const qint64 wms = timer.elapsed();
+    w.releaseDevice();
+    const qint64 size = QFileInfo(image).size();
+    QVERIFY(wms >= size * 1000 / throttled.writerate * 9 / 10);
+    fprintf(stderr, "check: %lld ms, %zu regions; throttled write: %lld ms for %lld bytes\n",
+            ms, size_t(res.regions.size()), wms, size);
+}
+
+void TestDISOMaster::test_cancelAndPause()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QDir(dir.path()).mkdir("data");
+    QFile f(dir.filePath("data/file"));
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    for (int i = 0; i < 8; ++i) {
+        f.write(QByteArray(1 << 20, char('a' + i)));
+    }
+    f.close();
+
+    const QString image = dir.filePath("disc.iso");
+    {
+        DISOMaster x;
+        x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+        QVERIFY(x.buildImage(QUrl::fromLocalFile(image)));
+    }
+
+    // about 4 seconds for a full read of the simulated disc
+    DriveSimulation sim;
+    sim.readlatency = 1000;
+    SimulatedDrive drive(image, sim);
+    QVERIFY(drive.isValid());
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(drive.device()));
+    QVERIFY(!x.pause());
+
+    // a paused dump reads nothing, and the resumed one misses nothing
+    QFuture<JobResult> dump = x.dumpISOAsync(QUrl::fromLocalFile(dir.filePath("dump.iso")), DumpMD5);
+    QTest::qWait(500);
+    QVERIFY(x.pause());
+    QTest::qWait(1500);
+    QVERIFY(x.isPaused());
+    const qint64 before = QFileInfo(dir.filePath("dump.iso")).size();
+    QTest::qWait(1000);
+    QCOMPARE(QFileInfo(dir.filePath("dump.iso")).size(), before);
+    QVERIFY(!dump.isFinished());
+    x.resume();
+    dump.waitForFinished();
+    QVERIFY(dump.result().success);
+    QFile img(image);
+    QVERIFY(img.open(QIODevice::ReadOnly));
+    QCOMPARE(dump.result().md5, QCryptographicHash::hash(img.readAll(), QCryptographicHash::Md5));
+
+    // cancelled, and the drive is held again right away
+    QFuture<JobResult> check = x.checkmediaRangeAsync(0);
+    QTest::qWait(500);
+    x.cancel();
+    check.waitForFinished();
+    const JobResult res = check.result();
+    QVERIFY(!res.success);
+    QVERIFY(res.cancelled);
+    QVERIFY(res.teardowntime >= 0 && res.teardowntime < 3000);
+    QVERIFY(res.elapsed < 3500);
+    QVERIFY(x.checkmediaRange(0, 32));
+    QVERIFY(!x.lastJobResult().cancelled);
+    x.releaseDevice();
+    fprintf(stderr, "cancelled after %lld ms, teardown %lld ms\n", res.elapsed, res.teardowntime);
+}
+
+void TestDISOMaster::test_handlePool()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    DISOMaster::setIdleHandleLimit(0);
+    DISOMaster::setIdleHandleLimit(1);
+    QCOMPARE(DISOMaster::idleHandles(), 0);
+
+    DISOMaster a;
+    QVERIFY(a.acquireDevice("stdio:" + dir.filePath("a.iso")));
+    QVERIFY(a.acquireLatency() > 0);
+    a.releaseDevice();
+    QCOMPARE(DISOMaster::idleHandles(), 1);
+    a.takeLogMessages();
+
+    // b gets the handle of a, without its drive and with its own messages
+    DISOMaster b;
+    QCOMPARE(DISOMaster::idleHandles(), 0);
+    QVERIFY(b.currentDevice().isEmpty());
+    QVERIFY(b.acquireDevice("stdio:" + dir.filePath("b.iso")));
+    b.releaseDevice();
+    bool seen = false;
+    for (const LogMessage &m : b.takeLogMessages()) {
+        seen = seen || m.text.contains("b.iso");
+    }
+    QVERIFY(seen);
+    QVERIFY(a.takeLogMessages().isEmpty());
+
+    // a leases again on acquire
+    QVERIFY(a.acquireDevice("stdio:" + dir.filePath("a.iso")));
+    a.releaseDevice();
+    QCOMPARE(DISOMaster::idleHandles(), 1);
+
+    DISOMaster::prewarmHandles(4);
+    QCOMPARE(DISOMaster::idleHandles(), 1);
+    fprintf(stderr, "construction %lld us (pooled), acquire %lld us\n", b.constructionLatency(), b.acquireLatency());
+    DISOMaster::setIdleHandleLimit(4);
+}
+
+void TestDISOMaster::test_dumpFollower()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("dump.iso");
+
+    // data, then 1 MiB of zeros, then data again
+    QByteArray image;
+    for (int i = 0; i < 3; ++i) {
+        QByteArray part(1 << 20, i == 1 ? '\0' : char('a' + i));
+        image += part;
+    }
+
+    DumpFollower f(path, DumpMD5 | DumpSHA256 | DumpSparse, 1 << 20);
+    QVERIFY(f.start());
+
+    // the writer appends while the follower reads behind it
+    QFile w(path);
+    QVERIFY(w.open(QIODevice::ReadWrite));
+    for (int off = 0; off < image.size(); off += 256 << 10) {
+        w.write(image.constData() + off, 256 << 10);
+        w.flush();
+        QThread::msleep(5);
+    }
+    w.close();
+    // trailing unreadable blocks are never written
+    QVERIFY(f.finish(true, image.size() + (1 << 20)));
+    image += QByteArray(1 << 20, '\0');
+
+    JobResult res;
+    f.fillResult(res);
+    QCOMPARE(res.dumpsize, qint64(image.size()));
+    QCOMPARE(res.md5, QCryptographicHash::hash(image, QCryptographicHash::Md5));
+    QCOMPARE(res.sha256, QCryptographicHash::hash(image, QCryptographicHash::Sha256));
+    QCOMPARE(res.chunkmd5.size(), 4);
+    QCOMPARE(res.chunksha256.at(2), QCryptographicHash::hash(image.mid(2 << 20, 1 << 20), QCryptographicHash::Sha256));
+
+    QFile r(path);
+    QVERIFY(r.open(QIODevice::ReadOnly));
+    QCOMPARE(r.readAll(), image);
+
+    struct stat st;
+    QCOMPARE(stat(QFile::encodeName(path).constData(), &st), 0);
+    fprintf(stderr, "dump: %lld bytes, %lld allocated\n", qint64(st.st_size), qint64(st.st_blocks) * 512);
+    QVERIFY(qint64(st.st_blocks) * 512 < st.st_size);
+
+    // digests asked for but no image file to hash: the dump fails
+    QVERIFY(!DumpFollower(dir.filePath("none/dump.iso"), DumpMD5, 0).start());
+    QDir(dir.path()).mkdir("data");
+    QFile data(dir.filePath("data/file"));
+    QVERIFY(data.open(QIODevice::WriteOnly));
+    data.write(QByteArray(1 << 20, 'd'));
+    data.close();
+    DISOMaster x;
+    x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+    QVERIFY(x.buildImage(QUrl::fromLocalFile(dir.filePath("disc.iso"))));
+    QVERIFY(x.acquireDevice("stdio:" + dir.filePath("disc.iso")));
+    QVERIFY(!x.dumpISO(QUrl::fromLocalFile(dir.filePath("none/dump.iso")), DumpMD5));
+    QVERIFY(!x.lastJobResult().success);
+    x.releaseDevice();
+}
+
+void TestDISOMaster::test_messageLog()
+{
+    LogMessage m = MessageLog::parse(1, "xorriso : SORRY : Cannot open file");
+    QCOMPARE(m.severity, LogMessage::Sorry);
+    QCOMPARE(m.category, LogMessage::InfoCategory);
+    m = MessageLog::parse(1, "xorriso : UPDATE :    12 of  2210 MB written");
+    QCOMPARE(m.category, LogMessage::ProgressCategory);
+    QCOMPARE(MessageLog::parse(0, "Media current: DVD+RW").category, LogMessage::ResultCategory);
+
+    // the oldest entries go once the ring is full
+    LogRing ring(16);
+    for (int i = 0; i < 40; ++i) {
+        LogMessage e;
+        e.text = QString::number(i);
+        ring.append(std::move(e));
+    }
+    QList<LogMessage> got = ring.drain();
+    QCOMPARE(got.size(), 16);
+    QCOMPARE(got.first().text, QString("24"));
+    QCOMPARE(got.last().text, QString("39"));
+    QCOMPARE(ring.dropped(), quint64(24));
+    QVERIFY(ring.drain().isEmpty());
+
+    // filtered out before they take a slot
+    MessageLog log(64);
+    log.setFilter(LogMessage::InfoCategory | LogMessage::ResultCategory, LogMessage::Note);
+    log.append(MessageLog::parse(1, "xorriso : UPDATE : 1 of 2 MB written"));
+    log.append(MessageLog::parse(1, "xorriso : DEBUG : something"));
+    log.append(MessageLog::parse(1, "xorriso : NOTE : something else"));
+    QCOMPARE(log.drain().size(), 1);
+
+    // a producer never waits for a consumer, and nothing is seen twice
+    LogRing shared(1024);
+    const int n = 200000;
+    std::atomic<bool> done(false);
+    std::thread producer([&shared, &done] {
+        for (int i = 0; i < n; ++i) {
+            LogMessage e;
+            e.timestamp = i;
+            shared.append(std::move(e));
+        }
+        done = true;
+    });
+    qint64 last = -1;
+    int taken = 0;
+    bool ordered = true;
+    for (bool finished = false; !finished;) {
+        finished = done;
+        for (const LogMessage &e : shared.drain()) {
+            ordered = ordered && e.timestamp > last;
+            last = e.timestamp;
+            ++taken;
+        }
+    }
+    producer.join();
+    QVERIFY(ordered);
+    QCOMPARE(taken + int(shared.dropped()), n);
+    fprintf(stderr, "%d messages: %d taken, %llu dropped\n", n, taken, shared.dropped());
+}
+
+void TestDISOMaster::test_classifyMessage()
+{
+    XorrisoMessage m = XorrisoMessage::classify("xorriso : UPDATE : Closing track/session.");
+    QCOMPARE(m.type, XorrisoMessage::PhaseChange);
+    QCOMPARE(m.phase, XorrisoMessage::ClosingSession);
+
+    m = XorrisoMessage::classify("xorriso : UPDATE :    12 of  2210 MB written (fifo 100%) [buf  98%]   4.0xD.");
+    QCOMPARE(m.type, XorrisoMessage::MBWritten);
+    QCOMPARE(m.done, 12.);
+    QCOMPARE(m.total, 2210.);
+    QCOMPARE(m.speed, QString("4.0x"));
+    QCOMPARE(m.fifo, 100);
+    QCOMPARE(m.buffer, 98);
+
+    m = XorrisoMessage::classify("xorriso : UPDATE : Blanking  ( 12.5% done in 3 seconds )");
+    QCOMPARE(m.type, XorrisoMessage::PercentDone);
+    QCOMPARE(m.done, 12.5);
+
+    m = XorrisoMessage::classify("xorriso : UPDATE : 102400 blocks read in 15 seconds , 4.6xD");
+    QCOMPARE(m.type, XorrisoMessage::BlocksRead);
+    QCOMPARE(m.done, 102400.);
+
+    m = XorrisoMessage::classify("Writing to '/dev/sr0' completed successfully.");
+    QCOMPARE(m.type, XorrisoMessage::Completion);
+
+    m = XorrisoMessage::classify("Media region : 1049088      64  - unreadable");
+    QCOMPARE(m.type, XorrisoMessage::MediaRegion);
+    QCOMPARE(m.lba, qint64(1049088));
+    QCOMPARE(m.blocks, qint64(64));
+    QCOMPARE(m.quality, QString("- unreadable"));
+
+    m = XorrisoMessage::classify("xorriso : SORRY : MD5 MISMATCH: '/data/it'\"'\"'s.txt'");
+    QCOMPARE(m.type, XorrisoMessage::MD5Mismatch);
+    QCOMPARE(m.path, QString("/data/it's.txt"));
+
+    // the classifier must agree with the old regex chain on recorded output
+    const QStringList log = loadMessageLog();
+    QVERIFY(!log.isEmpty());
+    for (const QString &msg : log) {
+        const XorrisoMessage old = legacyClassify(msg);
+        m = XorrisoMessage::classify(msg);
+        // records the old chain did not know about
+        if (m.type == XorrisoMessage::MediaRegion || m.type == XorrisoMessage::MD5Mismatch) {
+            QCOMPARE(old.type, XorrisoMessage::Other);
+            continue;
+        }
+        QCOMPARE(m.type, old.type);
+        QCOMPARE(m.phase, old.phase);
+        QCOMPARE(m.done, old.done);
+        QCOMPARE(m.total, old.total);
+        if (m.type != XorrisoMessage::PhaseChange) {
+            QCOMPARE(m.speed, old.speed);
+        }
+    }
+}
+
+void TestDISOMaster::test_watcherHandoff()
+{
+    QStringList log = loadMessageLog();
+    QVERIFY(!log.isEmpty());
+    log.push_back("xorriso : SORRY : MD5 MISMATCH: '/data/it'\"'\"'s.txt'");
+
+    QSet<QString> speeds { QString() };
+    int fills = 0;
+    int minfill = -1;
+    QVector<XorrisoMessage> stream;
+    for (const QString &msg : log) {
+        stream.push_back(XorrisoMessage::classify(msg));
+        const XorrisoMessage &m = stream.last();
+        if (m.type != XorrisoMessage::PhaseChange) {
+            speeds.insert(m.speed);
+            fills += m.fifo >= 0;
+            if (m.fifo >= 0 && (minfill < 0 || m.fifo < minfill)) {
+                minfill = m.fifo;
+            }
+        }
+    }
+    QVERIFY(fills > 0);
+
+    // the watcher replays the stream while everyone else reads
+    const int rounds = 200;
+    WatcherChannel channel;
+    std::atomic<bool> done(false);
+    std::thread watcher([&] {
+        for (int i = 0; i < rounds; ++i) {
+            for (const XorrisoMessage &m : stream) {
+                channel.post(m);
+            }
+        }
+        done = true;
+    });
+    std::atomic<int> torn(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&] {
+            while (!done) {
+                if (!speeds.contains(channel.speed()) || channel.fifo() > 100) {
+                    ++torn;
+                }
+            }
+        });
+    }
+
+    // failures are only counted here: a QCOMPARE would return with the threads still joinable
+    int badlows = 0;    //the minimum only goes down, and never below the true one
+    int lastlow = -1;
+    int mismatches = 0;
+    int badpaths = 0;
+    QString path;
+    for (bool finished = false; !finished;) {
+        finished = done;
+        const int low = channel.minFifo();
+        badlows += (lastlow >= 0 && (low < 0 || low > lastlow)) || (low >= 0 && low < minfill);
+        lastlow = low;
+        while (channel.takeMismatch(path)) {
+            badpaths += path != QString("/data/it's.txt");
+            ++mismatches;
+        }
+    }
+    watcher.join();
+    for (auto &t : readers) {
+        t.join();
+    }
+
+    QCOMPARE(torn.load(), 0);
+    QCOMPARE(badpaths, 0);
+    QCOMPARE(badlows, 0);
+    QCOMPARE(channel.minFifo(), minfill);
+    QCOMPARE(mismatches, rounds);
+    QCOMPARE(channel.speed(), stream.last().speed);
+
+    channel.post(stream.first());
+    channel.reset();
+    QVERIFY(!channel.takeMismatch(path));
+    QCOMPARE(channel.minFifo(), -1);
+    QCOMPARE(channel.speed(), QString());
+
+    // the same through a DISOMaster, whose watcher gets the messages of a commit
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QDir(dir.path()).mkdir("data");
+    for (int i = 0; i < 4; ++i) {
+        QFile f(dir.filePath(QString("data/f%1").arg(i)));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(QByteArray(64 << 20, char('h' + i)));
+    }
+    const QString dev = "stdio:" + dir.filePath("handoff.iso");
+    DISOMaster x;
+    QVERIFY(x.acquireDevice(dev));
+    // cached now: readers below do not touch the handle of the job
+    QCOMPARE(x.getDeviceProperty(MediaTypeField | CapacityField).devid, dev);
+    x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+
+    QFuture<JobResult> job = x.commitAsync(RockRidgeSupport);
+    std::atomic<int> badspeeds(0), badproperties(0), messages(0);
+    std::vector<std::thread> hammers;
+    hammers.emplace_back([&] {
+        while (!job.isFinished()) {
+            const QString speed = x.getCurrentSpeed();
+            bool ok = speed.isEmpty();
+            if (!ok) {
+                speed.left(speed.size() - 1).toDouble(&ok);
+            }
+            badspeeds += !ok;
+        }
+    });
+    hammers.emplace_back([&] {
+        while (!job.isFinished()) {
+            badproperties += x.getDeviceProperty(MediaTypeField | CapacityField).devid != dev;
+        }
+    });
+    hammers.emplace_back([&] {
+        while (!job.isFinished()) {
+            messages += x.getInfoMessages().size();
+        }
+    });
+    job.waitForFinished();
+    for (auto &t : hammers) {
+        t.join();
+    }
+    x.releaseDevice();
+
+    QVERIFY(job.result().success);
+    QCOMPARE(badspeeds.load(), 0);
+    QCOMPARE(badproperties.load(), 0);
+    QVERIFY(messages > 0);
+}
+
+void TestDISOMaster::test_stagingTree()
+{
+    StagingTree t;
+    t.insert("/data/sub", "/data/sub");
+    t.insert("/data", "/data");
+    t.insert("/data/other", "/elsewhere");
+    t.insert("/home/a", "/a");
+    QCOMPARE(t.size(), 4);
+    QCOMPARE(t.target("/data//sub/"), QString("/data/sub"));
+    QVERIFY(t.target("/data/none").isNull());
+
+    // deterministic order, covered entries dropped on request
+    QList<StagingTree::Entry> e = t.entries();
+    QCOMPARE(e.size(), 4);
+    QCOMPARE(e[0].first, QString("/data"));
+    QCOMPARE(e[1].first, QString("/data/other"));
+    QCOMPARE(e[2].first, QString("/data/sub"));
+    e = t.entries(true);
+    QCOMPARE(e.size(), 3);
+    QCOMPARE(e[1].second, QString("/elsewhere"));
+
+    QVERIFY(t.remove("/data"));
+    QVERIFY(!t.remove("/data"));
+    QCOMPARE(t.entries(true).size(), 3);
+    QCOMPARE(t.removeTree("/data"), 2);
+    QCOMPARE(t.size(), 1);
+    QCOMPARE(t.entries().first().first, QString("/home/a"));
+    t.clear();
+    QVERIFY(t.isEmpty());
+
+    // entries come back as staged
+    t.insert("file:///home/b", "/b");
+    t.insert("/home/c/", "/c");
+    e = t.entries();
+    QCOMPARE(e[0].first, QString("/home/c/"));
+    QCOMPARE(e[1].first, QString("file:///home/b"));
+    QCOMPARE(t.target("file:/home/b"), QString("/b"));
+    QVERIFY(t.remove("file:///home/b"));
+
+    DISOMaster x;
+    const quint64 empty = x.stagingMemoryUsage();
+    x.stageFiles({ { QUrl("file:///home/d"), QUrl("/d") } });
+    QCOMPARE(x.stagingFiles().keys().first().toString(), QString("file:///home/d"));
+    QHash<QUrl, QUrl> many;
+    for (int i = 0; i < 1000; ++i) {
+        many.insert(QUrl(QString("/home/many/f%1").arg(i)), QUrl(QString("/many/f%1").arg(i)));
+    }
+    x.stageFiles(many);
+    QVERIFY(x.stagingMemoryUsage() > empty + 1000 * sizeof(QString));
+}
+
+void TestDISOMaster::test_spanPlanner()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto create = [&dir](const QString &name, int size) {
+        QFile f(dir.filePath(name));
+        f.open(QIODevice::WriteOnly);
+        f.write(QByteArray(size, char('a' + size % 26)));
+    };
+    QDir(dir.path()).mkpath("data/photos");
+    QDir(dir.path()).mkpath("data/music");
+    QDir(dir.path()).mkpath("data/empty");
+    for (int i = 0; i < 3; ++i) {
+        create(QString("data/photos/p%1").arg(i), 300 << 10);
+    }
+    for (int i = 0; i < 2; ++i) {
+        create(QString("data/music/m%1").arg(i), 500 << 10);
+    }
+    create("data/big", 5 << 20);
+    const QList<StagingTree::Entry> entries { { dir.filePath("data"), "/data" } };
+    const qint64 capacity = 2 << 20;
+
+    // a file bigger than a disc
+    QVERIFY(SpanPlanner::plan(entries, capacity, KeepDirectories).isEmpty());
+
+    const QList<DiscPlan> plan = SpanPlanner::plan(entries, capacity, KeepDirectories | SplitLargeFiles);
+    QVERIFY(plan.size() >= 4);
+    QHash<QString, qint64> bytes;
+    QHash<QString, QSet<int>> discsof;
+    qint64 nextoffset = 0;
+    for (const DiscPlan &disc : plan) {
+        QVERIFY(disc.blocks <= capacity / 2048);
+        QVERIFY(disc.manifest.contains("disc " + QByteArray::number(disc.disc)));
+        for (const SpanFile &f : disc.files) {
+            bytes[f.source] += f.length;
+            discsof[f.target.section('/', 0, -2)].insert(disc.disc);
+            if (f.parts) {
+                QCOMPARE(f.offset, nextoffset);
+                nextoffset += f.length;
+            }
+        }
+    }
+    QCOMPARE(bytes.value(dir.filePath("data/big")), qint64(5 << 20));
+    QCOMPARE(nextoffset, qint64(5 << 20));
+    QCOMPARE(bytes.value(dir.filePath("data/music/m1")), qint64(500 << 10));
+    QVERIFY(bytes.contains(dir.filePath("data/empty")));
+    // each directory that fits on a disc is on one
+    QCOMPARE(discsof.value("/data/photos").size(), 1);
+    QCOMPARE(discsof.value("/data/music").size(), 1);
+
+    // exact sizes, and a disc of the plan built into an image
+    DISOMaster x;
+    x.stageFiles({ { QUrl(dir.filePath("data")), QUrl("/data") } });
+    const QList<DiscPlan> exact = x.planSpanning(capacity, KeepDirectories | SplitLargeFiles, RockRidgeSupport);
+    QVERIFY(!exact.isEmpty());
+    for (const DiscPlan &disc : exact) {
+        QVERIFY(disc.blocks > 0 && disc.blocks <= capacity / 2048);
+    }
+    x.stageDiscPlan(exact.first());
+    const QString image = dir.filePath("disc1.iso");
+    QVERIFY(x.buildImage(QUrl::fromLocalFile(image), RockRidgeSupport));
+    QVERIFY(QFileInfo(image).size() <= capacity);
+}
+
 QTEST_MAIN(TestDISOMaster)
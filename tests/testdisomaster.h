@@ -38,6 +38,32 @@ private Q_SLOTS:
     void test_isoWrite();
     void test_checkMedia();
     void test_dumpISO();
+    void test_asyncJobs();
+    void test_farmWriteISO();
+    void test_streamWriteISO();
+    void test_commitVerify();
+    void test_commitIncremental();
+    void test_deduplicate();
+    void test_buildImage();
+    void test_addPathspecs();
+    void test_writeSettings();
+    void test_mediaProfiles();
+    void test_progressEvents();
+    void test_deviceChanged();
+    void test_devicePropertyFields();
+    void test_listDevices();
+    void test_checkMediaRange();
+    void test_simulatedDrive();
+    void test_cancelAndPause();
+    void test_handlePool();
+    void test_dumpFollower();
+
+    void test_messageLog();
+    void test_classifyMessage();
+    void test_watcherHandoff();
+
+    void test_stagingTree();
+    void test_spanPlanner();
 
 };
 
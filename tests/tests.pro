@@ -2,7 +2,9 @@ QT += testlib
 QT -= gui
 CONFIG += NO_KEYWORDS
 LIBS += ../libdisomaster/libdisomaster.so
+LIBS += ../simulatedio/libsimulatedio.so
 HEADERS += \
+    legacyclassify.h \
     testdisomaster.h
 
 SOURCES += \